@@ -1,9 +1,20 @@
 #include "engine.h"
 #include <unordered_set>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <tuple>
+#include <emmintrin.h>
+#include <new>
+#include <chrono>
+#include <csignal>
 #include "SDL.h"
 #include "sound.h"
 #include "immediate_gui.h"
+#include "renderer.h"
 
 namespace FrameLog {
 	void clear();
@@ -13,6 +24,7 @@ namespace Engine {
 	int32_t current_fps = 0;
 
 	void init() {
+		Profiler::set_thread_name("main");
 		Input::init();
 		Sound::init();
 	}
@@ -29,8 +41,7 @@ namespace Engine {
 		
 		va_list args;
 		va_start(args, fmt);
-		printf("\n");
-		vprintf(fmt, args);
+		Log::write_va(Log::Info, Log::General, true, fmt, args);
 		va_end(args);
 	}
 
@@ -41,7 +52,7 @@ namespace Engine {
 
 		va_list args;
 		va_start(args, fmt);
-		vprintf(fmt, args);
+		Log::write_va(Log::Info, Log::General, false, fmt, args);
 		va_end(args);
 	}
 	
@@ -64,13 +75,30 @@ namespace Engine {
 	}
 
 	void update() {
+		PROFILE_SCOPE("update");
+		const uint64_t update_start = SDL_GetPerformanceCounter();
 		IGUI::frame();
 
+		if(Input::key_pressed(SDLK_F6)) {
+			Profiler::set_enabled(!Profiler::is_enabled());
+		}
+		if(Input::key_pressed(SDLK_F7) && !Profiler::is_capturing()) {
+			Profiler::capture(120, Text::format("profile_%u.json", SDL_GetTicks()));
+		}
+		if(Input::key_pressed(SDLK_F8)) {
+			PerfHud::set_enabled(!PerfHud::is_enabled());
+		}
+
 		if(FrameLog::is_enabled()) {
 			FrameLog::clear();
 			Time::delta_time = Engine::is_paused() ? 0.0f : Time::delta_time_raw;
-			FrameLog::log("dt: " + std::to_string(Time::delta_time));
-    		FrameLog::log("FPS: " + std::to_string(Engine::current_fps));
+		}
+		if(PerfHud::is_enabled()) {
+			const FramePacer::Stats pacer = FramePacer::stats();
+			PerfHud::gauge("dt", Time::delta_time);
+			PerfHud::counter("fps", Engine::current_fps);
+			PerfHud::counter("missed frames", pacer.missed_deadlines);
+			PerfHud::counter("dropped updates", pacer.dropped_updates);
 		}
 		if(pause_timer > 0.0f) {
 			pause_timer -= Time::delta_time_fixed;
@@ -80,15 +108,1350 @@ namespace Engine {
 
 		Scenes::update();
 		Scenes::switch_scenes();
+		camera_update();
+		const uint64_t update_ticks = SDL_GetPerformanceCounter() - update_start;
+		FlightRecorder::add_update(update_ticks);
+		PerfHud::add_timing(PerfHud::Update, (float)((double)update_ticks * 1000.0 / (double)SDL_GetPerformanceFrequency()));
 	}
 
+	static uint64_t last_render_end = 0;
+
 	void render() {
-		Scenes::render();
+		const uint64_t render_start = SDL_GetPerformanceCounter();
+		{
+			PROFILE_SCOPE("render");
+			Scenes::render();
+		}
+		const uint64_t render_end = SDL_GetPerformanceCounter();
+		const double ms_per_tick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+		// timings are always kept and the hud's own drawing is taken out of both,
+		// so turning the hud on shows the same numbers
+		const uint64_t hud_ticks = PerfHud::excluded();
+		PerfHud::add_timing(PerfHud::Render, (float)((double)(render_end - render_start - hud_ticks) * ms_per_tick));
+		if(last_render_end != 0) {
+			PerfHud::add_timing(PerfHud::Frame, (float)((double)(render_end - last_render_end - hud_ticks) * ms_per_tick));
+		}
+		last_render_end = render_end;
+		Profiler::frame();
+
+		if(Allocations::is_enabled()) {
+			Allocations::frame();
+			const Allocations::Counts &allocated = Allocations::last_frame();
+			PerfHud::counter("allocations", (int64_t)allocated.count);
+			PerfHud::counter("allocated bytes", (int64_t)allocated.bytes);
+			FlightRecorder::counter("allocations", (int64_t)allocated.count);
+		}
 	}
 
 	void cleanup() {
+		Jobs::shutdown();
 		Sound::quit();
 		Scenes::unload();
+		Log::shutdown();
+	}
+}
+
+namespace Jobs {
+	static std::vector<std::thread> workers;
+	static std::deque<std::function<void()>> queue;
+	static std::mutex mutex;
+	static std::condition_variable has_work;
+	static std::condition_variable done;
+	static size_t running = 0;
+	static bool stopping = false;
+
+	static void work() {
+		Profiler::set_thread_name("jobs");
+		std::unique_lock<std::mutex> lock(mutex);
+		while(true) {
+			has_work.wait(lock, [] { return stopping || !queue.empty(); });
+			if(queue.empty()) {
+				return;
+			}
+			std::function<void()> job = std::move(queue.front());
+			queue.pop_front();
+			running++;
+			lock.unlock();
+			job();
+			lock.lock();
+			running--;
+			if(queue.empty() && running == 0) {
+				done.notify_all();
+			}
+		}
+	}
+
+	void init(int threads) {
+		if(!workers.empty()) {
+			return;
+		}
+		if(threads <= 0) {
+			threads = (int)std::thread::hardware_concurrency() - 1;
+			threads = threads > 0 ? threads : 1;
+		}
+		stopping = false;
+		for(int i = 0; i < threads; i++) {
+			workers.push_back(std::thread(work));
+		}
+		Engine::logn("[JOBS] %d worker threads", threads);
+	}
+
+	void shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		has_work.notify_all();
+		// queued jobs are finished first
+		for(auto &worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	void submit(std::function<void()> job) {
+		if(workers.empty()) {
+			init(0);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(std::move(job));
+		}
+		has_work.notify_one();
+	}
+
+	int thread_count() {
+		return (int)workers.size();
+	}
+
+	size_t pending() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size() + running;
+	}
+
+	void wait_idle() {
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [] { return queue.empty() && running == 0; });
+	}
+}
+
+namespace Log {
+	// bounded multi producer single consumer ring, every slot has a sequence number
+	// that tells whether it is free to claim (== position) or written (== position + 1)
+	const uint32_t RING_SIZE = 4096;
+	const uint32_t TEXT_SIZE = 248;
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		uint32_t length;
+		char text[TEXT_SIZE];
+	};
+
+	static Slot ring[RING_SIZE];
+	static std::atomic<uint32_t> head(0);
+	static uint32_t tail = 0;
+	static std::atomic<uint32_t> dropped_count(0);
+	static uint32_t dropped_reported = 0;
+
+	// held by whoever is reading the ring and writing the output
+	static std::mutex consumer_mutex;
+	static FILE *output = nullptr;
+
+	enum State { NotStarted, Starting, Running, Stopped };
+	static std::atomic<int> state(NotStarted);
+	static std::thread writer;
+
+	// per call site, keyed by the format string
+	const int RATE_SLOTS = 256;
+	struct RateSlot {
+		std::atomic<const char*> fmt { nullptr };
+		std::atomic<uint32_t> window_start { 0 };
+		std::atomic<uint32_t> count { 0 };
+		std::atomic<uint32_t> suppressed { 0 };
+	};
+	static RateSlot rates[RATE_SLOTS];
+
+	static const char *level_names[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR" };
+
+	static void init_ring() {
+		static bool initialized = false;
+		if(!initialized) {
+			for(uint32_t i = 0; i < RING_SIZE; i++) {
+				ring[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			initialized = true;
+		}
+	}
+
+	static FILE *get_output() {
+		return output != nullptr ? output : stdout;
+	}
+
+	// consumer_mutex must be held, stops at the first slot that is claimed but not written yet
+	static uint32_t drain() {
+		uint32_t written = 0;
+		FILE *out = get_output();
+		while(true) {
+			Slot &slot = ring[tail & (RING_SIZE - 1)];
+			if(slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+				break;
+			}
+			fwrite(slot.text, 1, slot.length, out);
+			slot.sequence.store(tail + RING_SIZE, std::memory_order_release);
+			tail++;
+			written++;
+		}
+		uint32_t dropped = dropped_count.load(std::memory_order_relaxed);
+		if(dropped != dropped_reported) {
+			fprintf(out, "\n[LOG] ring full, dropped %u messages", dropped - dropped_reported);
+			dropped_reported = dropped;
+		}
+		return written;
+	}
+
+	static void writer_loop() {
+		Profiler::set_thread_name("log");
+		while(state.load(std::memory_order_acquire) == Running) {
+			uint32_t written;
+			{
+				std::lock_guard<std::mutex> lock(consumer_mutex);
+				written = drain();
+				if(written > 0) {
+					fflush(get_output());
+				}
+			}
+			if(written == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+	}
+
+	static void crash_handler(int signal_number) {
+		// best effort, the crash may have happened while the mutex was held
+		for(int i = 0; i < 100; i++) {
+			if(consumer_mutex.try_lock()) {
+				drain();
+				fflush(get_output());
+				consumer_mutex.unlock();
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		signal(signal_number, SIG_DFL);
+		raise(signal_number);
+	}
+
+	static void start() {
+		int expected = NotStarted;
+		if(!state.compare_exchange_strong(expected, Starting)) {
+			// someone else is starting it
+			while(state.load(std::memory_order_acquire) == Starting) {
+				std::this_thread::yield();
+			}
+			return;
+		}
+		init_ring();
+		signal(SIGSEGV, crash_handler);
+		signal(SIGABRT, crash_handler);
+		signal(SIGFPE, crash_handler);
+		signal(SIGILL, crash_handler);
+		state.store(Running, std::memory_order_release);
+		writer = std::thread(writer_loop);
+		// exits that skip Engine::cleanup still write what is queued and join the writer
+		atexit(shutdown);
+	}
+
+	void init(const char *path) {
+		if(state.load(std::memory_order_acquire) == NotStarted) {
+			start();
+		}
+		std::lock_guard<std::mutex> lock(consumer_mutex);
+		drain();
+		if(output != nullptr) {
+			fclose(output);
+			output = nullptr;
+		}
+		if(path != nullptr) {
+			output = fopen(path, "w");
+			if(output == nullptr) {
+				fprintf(stdout, "\n[LOG] could not open %s, writing to stdout", path);
+			}
+		}
+	}
+
+	void shutdown() {
+		int expected = Running;
+		if(!state.compare_exchange_strong(expected, Stopped)) {
+			return;
+		}
+		if(writer.joinable()) {
+			writer.join();
+		}
+		std::lock_guard<std::mutex> lock(consumer_mutex);
+		drain();
+		for(int i = 0; i < RATE_SLOTS; i++) {
+			const uint32_t suppressed = rates[i].suppressed.exchange(0, std::memory_order_relaxed);
+			if(suppressed > 0) {
+				fprintf(get_output(), "\n[LOG] suppressed %u messages like \"%.64s\"", suppressed, rates[i].fmt.load());
+			}
+		}
+		fflush(get_output());
+	}
+
+	void flush() {
+		if(state.load(std::memory_order_acquire) == NotStarted) {
+			return;
+		}
+		// wait for messages claimed before the call to be written, a producer
+		// that died mid message must not hang an assert so give up eventually
+		const uint32_t target = head.load(std::memory_order_acquire);
+		std::lock_guard<std::mutex> lock(consumer_mutex);
+		for(int spins = 0; (int32_t)(target - tail) > 0 && spins < 10000; spins++) {
+			if(drain() == 0) {
+				std::this_thread::yield();
+			}
+		}
+		fflush(get_output());
+	}
+
+	uint32_t dropped() {
+		return dropped_count.load(std::memory_order_relaxed);
+	}
+
+	static RateSlot *rate_slot(const char *fmt) {
+		const size_t hash = ((size_t)fmt >> 3) * 2654435761u;
+		for(int probe = 0; probe < 8; probe++) {
+			RateSlot &slot = rates[(hash + probe) & (RATE_SLOTS - 1)];
+			const char *current = slot.fmt.load(std::memory_order_acquire);
+			if(current == fmt) {
+				return &slot;
+			}
+			if(current == nullptr) {
+				if(slot.fmt.compare_exchange_strong(current, fmt) || current == fmt) {
+					return &slot;
+				}
+			}
+		}
+		// table is full, the call site is not limited
+		return nullptr;
+	}
+
+	static size_t format_prefix(char *buffer, size_t size, Level level, uint32_t category, bool newline) {
+		int length = 0;
+		if(newline) {
+			buffer[length++] = '\n';
+		}
+		if(category != General || level != Info) {
+			const char *category_name = "";
+			switch(category) {
+				case Render: category_name = "[RENDER]"; break;
+				case Battle: category_name = "[BATTLE]"; break;
+				case Map: category_name = "[MAP]"; break;
+				case Sound: category_name = "[SOUND]"; break;
+				case Resources: category_name = "[RESOURCES]"; break;
+				default: break;
+			}
+			length += snprintf(buffer + length, size - length, "[%s]%s ", level_names[level], category_name);
+		}
+		return (size_t)length < size ? (size_t)length : size - 1;
+	}
+
+	static void write_direct(Level level, uint32_t category, bool newline, const char *fmt, va_list args) {
+		char text[1024];
+		size_t length = format_prefix(text, sizeof(text), level, category, newline);
+		int written = vsnprintf(text + length, sizeof(text) - length, fmt, args);
+		length = written < 0 ? length : std::min(sizeof(text) - 1, length + (size_t)written);
+		std::lock_guard<std::mutex> lock(consumer_mutex);
+		fwrite(text, 1, length, get_output());
+	}
+
+	static void push(Level level, uint32_t category, bool newline, const char *fmt, va_list args) {
+		uint32_t position = head.load(std::memory_order_relaxed);
+		Slot *slot;
+		while(true) {
+			slot = &ring[position & (RING_SIZE - 1)];
+			const uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+			const int32_t difference = (int32_t)(sequence - position);
+			if(difference == 0) {
+				if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if(difference < 0) {
+				// full, the writer can't keep up so drop rather than wait
+				dropped_count.fetch_add(1, std::memory_order_relaxed);
+				return;
+			} else {
+				position = head.load(std::memory_order_relaxed);
+			}
+		}
+
+		size_t length = format_prefix(slot->text, TEXT_SIZE, level, category, newline);
+		int written = vsnprintf(slot->text + length, TEXT_SIZE - length, fmt, args);
+		if(written >= 0 && length + written >= TEXT_SIZE) {
+			// truncated
+			memcpy(slot->text + TEXT_SIZE - 4, "...", 3);
+			length = TEXT_SIZE - 1;
+		} else if(written > 0) {
+			length += written;
+		}
+		slot->length = (uint32_t)length;
+		slot->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	static void push_note(const char *fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		push(Info, General, true, fmt, args);
+		va_end(args);
+	}
+
+	// false when the call site has used up its messages for this second
+	static bool allow(const char *fmt) {
+		RateSlot *slot = rate_slot(fmt);
+		if(slot == nullptr) {
+			return true;
+		}
+		const uint32_t now = SDL_GetTicks();
+		uint32_t window_start = slot->window_start.load(std::memory_order_relaxed);
+		if(now - window_start >= 1000 && slot->window_start.compare_exchange_strong(window_start, now)) {
+			slot->count.store(0, std::memory_order_relaxed);
+			const uint32_t suppressed = slot->suppressed.exchange(0, std::memory_order_relaxed);
+			if(suppressed > 0) {
+				push_note("[LOG] suppressed %u messages like \"%.64s\"", suppressed, fmt);
+			}
+		}
+		if(slot->count.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_LIMIT) {
+			return true;
+		}
+		slot->suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	void write_va(Level level, uint32_t category, bool newline, const char *fmt, va_list args) {
+		int current = state.load(std::memory_order_acquire);
+		if(current == NotStarted || current == Starting) {
+			start();
+			current = state.load(std::memory_order_acquire);
+		}
+		if(current == Stopped) {
+			write_direct(level, category, newline, fmt, args);
+			return;
+		}
+		if(!allow(fmt)) {
+			return;
+		}
+		push(level, category, newline, fmt, args);
+	}
+
+	void write(Level level, uint32_t category, const char *fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		write_va(level, category, true, fmt, args);
+		va_end(args);
+	}
+}
+
+namespace Allocations {
+	// nothing in here may allocate, it runs inside operator new
+	struct Label {
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> bytes;
+		// totals at the last frame
+		uint64_t frame_count;
+		uint64_t frame_bytes;
+		Counts last_frame;
+	};
+
+	static std::atomic<bool> enabled(false);
+	static std::atomic<uint64_t> total_count(0);
+	static std::atomic<uint64_t> total_bytes(0);
+	static Label label_table[MAX_LABELS];
+	static thread_local const char *current_label = nullptr;
+	static uint64_t frame_total_count = 0;
+	static uint64_t frame_total_bytes = 0;
+	static Counts frame_counts = { 0, 0 };
+
+	Tag::Tag(const char *name) {
+		previous = label_swap(name);
+	}
+
+	Tag::~Tag() {
+		label_swap(previous);
+	}
+
+	const char *label_swap(const char *name) {
+		const char *previous = current_label;
+		current_label = name;
+		return previous;
+	}
+
+	void set_enabled(bool tracking) {
+		enabled = tracking;
+	}
+
+	bool is_enabled() {
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	// claims a free slot the first time a label is seen, the last slot takes
+	// everything once the table is full
+	static Label &label_get(const char *name) {
+		for(int i = 0; i < MAX_LABELS - 1; i++) {
+			const char *slot = label_table[i].name.load(std::memory_order_acquire);
+			if(slot == name) {
+				return label_table[i];
+			}
+			if(slot == nullptr) {
+				if(label_table[i].name.compare_exchange_strong(slot, name) || slot == name) {
+					return label_table[i];
+				}
+			}
+		}
+		label_table[MAX_LABELS - 1].name = "other";
+		return label_table[MAX_LABELS - 1];
+	}
+
+	void record(size_t bytes) {
+		if(!enabled.load(std::memory_order_relaxed)) {
+			return;
+		}
+		total_count.fetch_add(1, std::memory_order_relaxed);
+		total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		Label &label = label_get(current_label != nullptr ? current_label : "untagged");
+		label.count.fetch_add(1, std::memory_order_relaxed);
+		label.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	Counts total() {
+		return { total_count.load(std::memory_order_relaxed), total_bytes.load(std::memory_order_relaxed) };
+	}
+
+	// keeps the largest counts in out, insertion sorted since out is small
+	static int insert_sorted(LabelCounts *out, int used, int max, const char *name, const Counts &counts) {
+		if(counts.count == 0 || max <= 0) {
+			return used;
+		}
+		int i = used < max ? used : max - 1;
+		if(used == max && out[i].counts.count >= counts.count) {
+			return used;
+		}
+		for(; i > 0 && out[i - 1].counts.count < counts.count; i--) {
+			out[i] = out[i - 1];
+		}
+		out[i] = { name, counts };
+		return used < max ? used + 1 : used;
+	}
+
+	int labels(LabelCounts *out, int max) {
+		int used = 0;
+		for(auto &label : label_table) {
+			const char *name = label.name.load(std::memory_order_acquire);
+			if(name != nullptr) {
+				Counts counts = { label.count.load(std::memory_order_relaxed), label.bytes.load(std::memory_order_relaxed) };
+				used = insert_sorted(out, used, max, name, counts);
+			}
+		}
+		return used;
+	}
+
+	void reset() {
+		total_count = 0;
+		total_bytes = 0;
+		frame_total_count = 0;
+		frame_total_bytes = 0;
+		for(auto &label : label_table) {
+			label.count = 0;
+			label.bytes = 0;
+			label.frame_count = 0;
+			label.frame_bytes = 0;
+		}
+	}
+
+	void frame() {
+		const Counts now = total();
+		frame_counts = { now.count - frame_total_count, now.bytes - frame_total_bytes };
+		frame_total_count = now.count;
+		frame_total_bytes = now.bytes;
+		for(auto &label : label_table) {
+			const uint64_t count = label.count.load(std::memory_order_relaxed);
+			const uint64_t bytes = label.bytes.load(std::memory_order_relaxed);
+			label.last_frame = { count - label.frame_count, bytes - label.frame_bytes };
+			label.frame_count = count;
+			label.frame_bytes = bytes;
+		}
+	}
+
+	const Counts &last_frame() {
+		return frame_counts;
+	}
+
+	int last_frame_labels(LabelCounts *out, int max) {
+		int used = 0;
+		for(auto &label : label_table) {
+			const char *name = label.name.load(std::memory_order_acquire);
+			if(name != nullptr) {
+				used = insert_sorted(out, used, max, name, label.last_frame);
+			}
+		}
+		return used;
+	}
+}
+
+#ifndef ALLOCATION_TRACKING_DISABLED
+void *operator new(size_t size) {
+	Allocations::record(size);
+	void *p = malloc(size > 0 ? size : 1);
+	if(p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	Allocations::record(size);
+	return malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	free(p);
+}
+#endif
+
+namespace Profiler {
+	std::atomic<bool> _enabled(false);
+
+	struct Event {
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+		uint32_t depth;
+	};
+
+	// single writer (the owning thread), single reader (frame)
+	const uint32_t RING_SIZE = 8192;
+	struct ThreadRing {
+		Event events[RING_SIZE];
+		std::atomic<uint32_t> write { 0 };
+		std::atomic<uint32_t> read { 0 };
+		std::atomic<uint32_t> dropped { 0 };
+		int id = 0;
+		char name[32];
+	};
+
+	static std::mutex rings_mutex;
+	static std::vector<std::unique_ptr<ThreadRing>> rings;
+	static thread_local ThreadRing *thread_ring = nullptr;
+	static thread_local uint32_t thread_depth = 0;
+	static thread_local char current_thread_name[32] = "";
+
+	static ThreadRing *get_thread_ring() {
+		if(thread_ring == nullptr) {
+			std::unique_ptr<ThreadRing> ring(new ThreadRing());
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			ring->id = (int)rings.size();
+			if(current_thread_name[0] != '\0') {
+				snprintf(ring->name, sizeof(ring->name), "%s", current_thread_name);
+			} else {
+				snprintf(ring->name, sizeof(ring->name), "thread %d", ring->id);
+			}
+			thread_ring = ring.get();
+			rings.push_back(std::move(ring));
+		}
+		return thread_ring;
+	}
+
+	void set_thread_name(const char *name) {
+		snprintf(current_thread_name, sizeof(current_thread_name), "%s", name);
+		if(thread_ring != nullptr) {
+			snprintf(thread_ring->name, sizeof(thread_ring->name), "%s", name);
+		}
+	}
+
+	void Scope::begin() {
+		previous_label = Allocations::label_swap(name);
+		start = SDL_GetPerformanceCounter();
+		thread_depth++;
+	}
+
+	void Scope::end() {
+		const uint64_t now = SDL_GetPerformanceCounter();
+		thread_depth--;
+		Allocations::label_swap(previous_label);
+		ThreadRing *ring = get_thread_ring();
+		const uint32_t write = ring->write.load(std::memory_order_relaxed);
+		if(write - ring->read.load(std::memory_order_acquire) >= RING_SIZE) {
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		ring->events[write & (RING_SIZE - 1)] = { name, start, now, thread_depth };
+		ring->write.store(write + 1, std::memory_order_release);
+	}
+
+	// zones are the same name under the same parent
+	struct Zone {
+		const char *name;
+		int parent;
+		int depth;
+		double frame_ms;
+		uint32_t frame_calls;
+		double min_ms;
+		double max_ms;
+		double total_ms;
+		uint32_t frames;
+		uint32_t calls;
+	};
+
+	struct ZoneKeyLess {
+		bool operator()(const std::pair<int, const char*> &a, const std::pair<int, const char*> &b) const {
+			if(a.first != b.first) {
+				return a.first < b.first;
+			}
+			return strcmp(a.second, b.second) < 0;
+		}
+	};
+
+	struct ThreadEvent {
+		Event event;
+		int thread;
+	};
+
+	static std::vector<Zone> zones;
+	static std::map<std::pair<int, const char*>, int, ZoneKeyLess> zone_lookup;
+	static std::vector<ZoneStats> published;
+	static std::vector<Event> drained;
+	static std::vector<int> parents;
+	static uint32_t window_frames = 0;
+	const uint32_t WINDOW_FRAMES = 60;
+
+	static std::vector<ThreadEvent> captured;
+	static int capture_frames_left = 0;
+	static std::string capture_path;
+	static bool stats_enabled = false;
+	static ZoneListener listener = nullptr;
+
+	// zones are recorded while anything wants them
+	static void update_recording() {
+		_enabled = stats_enabled || capture_frames_left > 0 || listener != nullptr;
+	}
+
+	void set_enabled(bool enabled) {
+		stats_enabled = enabled;
+		update_recording();
+	}
+
+	bool is_enabled() {
+		return stats_enabled;
+	}
+
+	void set_listener(ZoneListener zone_listener) {
+		listener = zone_listener;
+		update_recording();
+	}
+
+	const char *thread_name(int thread) {
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		return thread >= 0 && thread < (int)rings.size() ? rings[thread]->name : "";
+	}
+
+	bool is_capturing() {
+		return capture_frames_left > 0;
+	}
+
+	void capture(int frames, const std::string &path) {
+		captured.clear();
+		capture_frames_left = frames;
+		capture_path = path;
+		update_recording();
+	}
+
+	static int zone_get(int parent, const char *name) {
+		auto key = std::make_pair(parent, name);
+		auto it = zone_lookup.find(key);
+		if(it != zone_lookup.end()) {
+			return it->second;
+		}
+		Zone zone = {};
+		zone.name = name;
+		zone.parent = parent;
+		zone.depth = parent >= 0 ? zones[parent].depth + 1 : 0;
+		zone.min_ms = 1e9;
+		zones.push_back(zone);
+		zone_lookup[key] = (int)zones.size() - 1;
+		return (int)zones.size() - 1;
+	}
+
+	static void write_capture() {
+		FILE *file = fopen(capture_path.c_str(), "w");
+		if(file == NULL) {
+			Engine::logn("[PROFILER] could not write %s", capture_path.c_str());
+			return;
+		}
+		uint64_t first = captured.empty() ? 0 : captured[0].event.start;
+		for(auto &e : captured) {
+			first = e.event.start < first ? e.event.start : first;
+		}
+		const double us_per_tick = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+
+		fprintf(file, "{\"traceEvents\":[\n");
+		{
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			for(auto &ring : rings) {
+				fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", ring->id, ring->name);
+			}
+		}
+		for(size_t i = 0; i < captured.size(); i++) {
+			const Event &e = captured[i].event;
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n", e.name, captured[i].thread,
+				(double)(e.start - first) * us_per_tick, (double)(e.end - e.start) * us_per_tick, i + 1 < captured.size() ? "," : "");
+		}
+		fprintf(file, "]}\n");
+		fclose(file);
+		Engine::logn("[PROFILER] wrote %d events to %s", (int)captured.size(), capture_path.c_str());
+		captured.clear();
+	}
+
+	static void publish() {
+		published.clear();
+		// depth first so children follow their parent
+		std::function<void(int)> add = [&](int parent) {
+			for(int i = 0; i < (int)zones.size(); i++) {
+				Zone &zone = zones[i];
+				if(zone.parent != parent || zone.frames == 0) {
+					continue;
+				}
+				ZoneStats stats;
+				stats.name = zone.name;
+				stats.depth = zone.depth;
+				stats.calls = zone.calls / zone.frames;
+				stats.min_ms = (float)zone.min_ms;
+				stats.mean_ms = (float)(zone.total_ms / zone.frames);
+				stats.max_ms = (float)zone.max_ms;
+				published.push_back(stats);
+				add(i);
+			}
+		};
+		add(-1);
+
+		for(auto &zone : zones) {
+			zone.min_ms = 1e9;
+			zone.max_ms = 0;
+			zone.total_ms = 0;
+			zone.frames = 0;
+			zone.calls = 0;
+		}
+		window_frames = 0;
+	}
+
+	void frame() {
+		const bool recording = _enabled.load(std::memory_order_relaxed);
+		const double ms_per_tick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+
+		std::unique_lock<std::mutex> lock(rings_mutex);
+		for(auto &ring : rings) {
+			const uint32_t write = ring->write.load(std::memory_order_acquire);
+			uint32_t read = ring->read.load(std::memory_order_relaxed);
+			drained.clear();
+			for(; read != write; read++) {
+				drained.push_back(ring->events[read & (RING_SIZE - 1)]);
+			}
+			ring->read.store(read, std::memory_order_release);
+			if(!recording || drained.empty()) {
+				continue;
+			}
+
+			// children end before their parents, in start order each parent comes
+			// right before its children. A parent that started before the profiler
+			// was enabled or is still running leaves its children at the top.
+			std::sort(drained.begin(), drained.end(), [](const Event &a, const Event &b) {
+				return a.start != b.start ? a.start < b.start : a.depth < b.depth;
+			});
+			parents.clear();
+			for(auto &e : drained) {
+				if(stats_enabled) {
+					if(parents.size() > e.depth) {
+						parents.resize(e.depth);
+					}
+					int zone_index = zone_get(parents.empty() ? -1 : parents.back(), e.name);
+					Zone &zone = zones[zone_index];
+					zone.frame_ms += (double)(e.end - e.start) * ms_per_tick;
+					zone.frame_calls++;
+					parents.push_back(zone_index);
+				}
+				if(capture_frames_left > 0) {
+					captured.push_back({ e, ring->id });
+				}
+				if(listener != nullptr) {
+					listener(e.name, e.start, e.end, ring->id);
+				}
+			}
+		}
+		lock.unlock();
+
+		if(capture_frames_left > 0 && --capture_frames_left == 0) {
+			write_capture();
+			update_recording();
+		}
+
+		if(!stats_enabled) {
+			return;
+		}
+
+		for(auto &zone : zones) {
+			if(zone.frame_calls == 0) {
+				continue;
+			}
+			zone.min_ms = zone.frame_ms < zone.min_ms ? zone.frame_ms : zone.min_ms;
+			zone.max_ms = zone.frame_ms > zone.max_ms ? zone.frame_ms : zone.max_ms;
+			zone.total_ms += zone.frame_ms;
+			zone.calls += zone.frame_calls;
+			zone.frames++;
+			zone.frame_ms = 0;
+			zone.frame_calls = 0;
+		}
+
+		if(++window_frames >= WINDOW_FRAMES) {
+			publish();
+		}
+	}
+
+	const std::vector<ZoneStats> &zone_stats() {
+		return published;
+	}
+}
+
+namespace FlightRecorder {
+	struct ZoneRecord {
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+		int thread;
+	};
+
+	struct FrameRecord {
+		uint64_t start;
+		uint64_t end;
+		uint64_t first_zone;
+		uint32_t zone_count;
+		uint32_t updates;
+		uint64_t update_ticks;
+		int64_t counters[MAX_COUNTERS];
+	};
+
+	const int ZONES_PER_FRAME = 128;
+
+	static bool enabled = false;
+	static float threshold_ms = 0;
+	static std::vector<FrameRecord> frames;
+	static std::vector<ZoneRecord> zones;
+	// totals, the rings are indexed with them modulo their size
+	static uint64_t frames_written = 0;
+	static uint64_t zones_written = 0;
+	static FrameRecord *current = nullptr;
+	static const char *counter_names[MAX_COUNTERS];
+	static int counter_count = 0;
+	static uint64_t window_ticks = 0;
+	static uint64_t next_dump = 0;
+
+	static void record_zone(const char *name, uint64_t start, uint64_t end, int thread) {
+		zones[zones_written % zones.size()] = { name, start, end, thread };
+		zones_written++;
+		if(current != nullptr) {
+			current->zone_count++;
+		}
+	}
+
+	void enable(float seconds, float frame_threshold_ms) {
+		// unlimited fps has no rate to size by, assume a fast one
+		const int fps = FramePacer::target_fps() > 0 ? FramePacer::target_fps() : 240;
+		const size_t frame_count = (size_t)(seconds * fps) + 1;
+		frames.assign(frame_count, FrameRecord());
+		zones.assign(frame_count * ZONES_PER_FRAME, ZoneRecord());
+		frames_written = 0;
+		zones_written = 0;
+		current = nullptr;
+		threshold_ms = frame_threshold_ms;
+		window_ticks = (uint64_t)(seconds * (double)SDL_GetPerformanceFrequency());
+		next_dump = 0;
+		enabled = true;
+		Profiler::set_listener(record_zone);
+		Engine::logn("[RECORDER] keeping %d frames, %d kb, dumping frames over %.1f ms", (int)frame_count, 
+			(int)((frames.size() * sizeof(FrameRecord) + zones.size() * sizeof(ZoneRecord)) / 1024), threshold_ms);
+	}
+
+	void disable() {
+		enabled = false;
+		current = nullptr;
+		Profiler::set_listener(nullptr);
+	}
+
+	bool is_enabled() {
+		return enabled;
+	}
+
+	void frame_begin() {
+		if(!enabled) {
+			return;
+		}
+		FrameRecord &frame = frames[frames_written % frames.size()];
+		if(current != nullptr) {
+			memcpy(frame.counters, current->counters, sizeof(frame.counters));
+		} else {
+			memset(frame.counters, 0, sizeof(frame.counters));
+		}
+		frame.start = SDL_GetPerformanceCounter();
+		frame.end = frame.start;
+		frame.first_zone = zones_written;
+		frame.zone_count = 0;
+		frame.updates = 0;
+		frame.update_ticks = 0;
+		current = &frame;
+		frames_written++;
+	}
+
+	void frame_end() {
+		if(!enabled || current == nullptr) {
+			return;
+		}
+		current->end = SDL_GetPerformanceCounter();
+		const double frame_ms = (double)(current->end - current->start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+		if(frame_ms > threshold_ms && current->end >= next_dump) {
+			dump(Text::format("%.2f ms frame", frame_ms).c_str());
+			// the next dump starts after everything in this one
+			next_dump = SDL_GetPerformanceCounter() + window_ticks;
+		}
+	}
+
+	void add_update(uint64_t ticks) {
+		if(current != nullptr) {
+			current->updates++;
+			current->update_ticks += ticks;
+		}
+	}
+
+	void counter(const char *name, int64_t value) {
+		if(current == nullptr) {
+			return;
+		}
+		for(int i = 0; i < counter_count; i++) {
+			if(counter_names[i] == name || strcmp(counter_names[i], name) == 0) {
+				current->counters[i] = value;
+				return;
+			}
+		}
+		if(counter_count < MAX_COUNTERS) {
+			counter_names[counter_count] = name;
+			current->counters[counter_count++] = value;
+		}
+	}
+
+	void dump(const char *reason) {
+		if(frames_written == 0) {
+			return;
+		}
+
+		char path[64];
+		time_t now = time(NULL);
+		strftime(path, sizeof(path), "spike_%Y%m%d_%H%M%S.json", localtime(&now));
+		FILE *file = fopen(path, "w");
+		if(file == NULL) {
+			Engine::logn("[RECORDER] could not write %s", path);
+			return;
+		}
+
+		const uint64_t newest = frames_written - 1;
+		const uint64_t oldest = frames_written > frames.size() ? frames_written - frames.size() : 0;
+		const uint64_t newest_end = frames[newest % frames.size()].end;
+		const uint64_t window_start = newest_end > window_ticks ? newest_end - window_ticks : 0;
+		const double us_per_tick = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+		uint64_t first = newest;
+		while(first > oldest && frames[(first - 1) % frames.size()].start >= window_start) {
+			first--;
+		}
+		const uint64_t origin = frames[first % frames.size()].start;
+		const int frames_thread = 1000;
+
+		fprintf(file, "{\"otherData\":{\"reason\":\"%s\"},\"traceEvents\":[\n", reason);
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"frames\"}}", frames_thread);
+		int threads_named = 0;
+		int zones_dumped = 0;
+		for(uint64_t f = first; f <= newest; f++) {
+			const FrameRecord &frame = frames[f % frames.size()];
+			const double ts = (double)(frame.start - origin) * us_per_tick;
+			fprintf(file, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"updates\":%u,\"update_ms\":%.3f}}",
+				frames_thread, ts, (double)(frame.end - frame.start) * us_per_tick, frame.updates, (double)frame.update_ticks * us_per_tick / 1000.0);
+			for(int c = 0; c < counter_count; c++) {
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{\"value\":%lld}}", counter_names[c], ts, (long long)frame.counters[c]);
+			}
+			// the oldest zones may have been written over already
+			uint64_t z = frame.first_zone;
+			if(zones_written - z > zones.size()) {
+				z = zones_written - zones.size();
+			}
+			for(; z < frame.first_zone + frame.zone_count; z++) {
+				const ZoneRecord &zone = zones[z % zones.size()];
+				if(zone.start < origin) {
+					continue;
+				}
+				while(threads_named <= zone.thread) {
+					fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", threads_named, Profiler::thread_name(threads_named));
+					threads_named++;
+				}
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", zone.name, zone.thread,
+					(double)(zone.start - origin) * us_per_tick, (double)(zone.end - zone.start) * us_per_tick);
+				zones_dumped++;
+			}
+		}
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		Engine::logn("[RECORDER] %s, wrote %d frames and %d zones to %s", reason, (int)(newest - first + 1), zones_dumped, path);
+	}
+}
+
+namespace PerfHud {
+	static bool enabled = false;
+	static TimingHistory histories[TimingCount];
+	static Value values[MAX_VALUES];
+	static int values_used = 0;
+	static uint64_t excluded_ticks = 0;
+
+	void set_enabled(bool hud_enabled) {
+		enabled = hud_enabled;
+	}
+
+	bool is_enabled() {
+		return enabled;
+	}
+
+	static inline int bin_of(float ms) {
+		int bin = (int)(ms / BIN_MS);
+		return bin < 0 ? 0 : (bin > BINS ? BINS : bin);
+	}
+
+	void add_timing(Timing timing, float ms) {
+		TimingHistory &h = histories[timing];
+		float &slot = h.samples[h.written % HISTORY];
+		if(h.written >= (uint32_t)HISTORY) {
+			h.bins[bin_of(slot)]--;
+		}
+		slot = ms;
+		h.bins[bin_of(ms)]++;
+		h.written++;
+	}
+
+	void exclude(uint64_t ticks) {
+		excluded_ticks += ticks;
+	}
+
+	uint64_t excluded() {
+		uint64_t ticks = excluded_ticks;
+		excluded_ticks = 0;
+		return ticks;
+	}
+
+	static Value *value_get(const char *name) {
+		for(int i = 0; i < values_used; i++) {
+			if(values[i].name == name || strcmp(values[i].name, name) == 0) {
+				return &values[i];
+			}
+		}
+		if(values_used == MAX_VALUES) {
+			return nullptr;
+		}
+		Value &value = values[values_used++];
+		value.name = name;
+		return &value;
+	}
+
+	void counter(const char *name, int64_t value) {
+		if(Value *v = value_get(name)) {
+			v->is_gauge = false;
+			v->counter = value;
+		}
+	}
+
+	void gauge(const char *name, float value) {
+		if(Value *v = value_get(name)) {
+			v->is_gauge = true;
+			v->gauge = value;
+		}
+	}
+
+	const TimingHistory &history(Timing timing) {
+		return histories[timing];
+	}
+
+	Percentiles percentiles(Timing timing) {
+		const TimingHistory &h = histories[timing];
+		const uint32_t count = h.written < (uint32_t)HISTORY ? h.written : (uint32_t)HISTORY;
+		Percentiles p = { 0, 0, 0 };
+		if(count == 0) {
+			return p;
+		}
+		// smallest bin holding at least this many samples
+		const uint32_t rank50 = (count * 50 + 99) / 100;
+		const uint32_t rank95 = (count * 95 + 99) / 100;
+		const uint32_t rank99 = (count * 99 + 99) / 100;
+		uint32_t seen = 0;
+		for(int bin = 0; bin <= BINS; bin++) {
+			if(h.bins[bin] == 0) {
+				continue;
+			}
+			const uint32_t before = seen;
+			seen += h.bins[bin];
+			const float edge = (bin + 1) * BIN_MS;
+			if(before < rank50 && seen >= rank50) {
+				p.p50 = edge;
+			}
+			if(before < rank95 && seen >= rank95) {
+				p.p95 = edge;
+			}
+			if(before < rank99 && seen >= rank99) {
+				p.p99 = edge;
+				break;
+			}
+		}
+		return p;
+	}
+
+	int value_count() {
+		return values_used;
+	}
+
+	const Value &value(int index) {
+		return values[index];
+	}
+}
+
+namespace FramePacer {
+	// wait() runs on the main thread, in pipelined mode scenes change the target and
+	// updates are dropped on the simulation thread. Only wait() touches the pacing
+	// state, target changes are queued and applied at the top of it.
+	static std::atomic<int> target(0);
+	static std::atomic<int> requested_target(-1);
+	static int default_target = 0;
+	static uint64_t frame_ticks = 0;
+	static uint64_t deadline = 0;
+	static uint64_t granularity_ticks = 0;
+	static float sleep_granularity_ms = 0;
+	static std::atomic<uint32_t> missed_deadlines(0);
+	static std::atomic<float> worst_overshoot_ms(0);
+	static std::atomic<uint32_t> dropped_updates(0);
+
+	static void apply_target(int fps) {
+		target = fps;
+		frame_ticks = fps > 0 ? SDL_GetPerformanceFrequency() / (uint64_t)fps : 0;
+		deadline = 0;
+	}
+
+	void init(int target_fps) {
+		// worst case of a few short sleeps, 1 ms on most systems but can be ~15 ms on windows
+		const uint64_t frequency = SDL_GetPerformanceFrequency();
+		uint64_t worst = 0;
+		for(int i = 0; i < 8; i++) {
+			uint64_t start = SDL_GetPerformanceCounter();
+			SDL_Delay(1);
+			uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+			worst = elapsed > worst ? elapsed : worst;
+		}
+		granularity_ticks = worst;
+		sleep_granularity_ms = (float)((double)worst * 1000.0 / (double)frequency);
+		Engine::logn("[PACER] sleep granularity %.2f ms", sleep_granularity_ms);
+
+		default_target = target_fps;
+		apply_target(target_fps > 0 ? target_fps : 0);
+	}
+
+	void set_target_fps(int fps) {
+		requested_target = fps > 0 ? fps : 0;
+	}
+
+	int target_fps() {
+		const int requested = requested_target;
+		return requested >= 0 ? requested : target.load();
+	}
+
+	int default_target_fps() {
+		return default_target;
+	}
+
+	void wait() {
+		const int requested = requested_target.exchange(-1);
+		if(requested >= 0) {
+			apply_target(requested);
+		}
+		if(frame_ticks == 0) {
+			return;
+		}
+
+		uint64_t now = SDL_GetPerformanceCounter();
+		if(deadline == 0) {
+			deadline = now + frame_ticks;
+			return;
+		}
+
+		if(now > deadline) {
+			const float overshoot_ms = (float)((double)(now - deadline) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+			if(overshoot_ms > worst_overshoot_ms) {
+				worst_overshoot_ms = overshoot_ms;
+			}
+			if(now - deadline > frame_ticks) {
+				// too far behind, start over from now instead of rushing frames
+				missed_deadlines++;
+				deadline = now + frame_ticks;
+				return;
+			}
+		} else {
+			const uint64_t frequency = SDL_GetPerformanceFrequency();
+			uint64_t remaining = deadline - now;
+			if(remaining > granularity_ticks) {
+				SDL_Delay((Uint32)((remaining - granularity_ticks) * 1000 / frequency));
+			}
+			while(SDL_GetPerformanceCounter() < deadline) {
+				// spin the last part
+			}
+		}
+		deadline += frame_ticks;
+	}
+
+	void drop_updates(uint32_t count) {
+		dropped_updates += count;
+	}
+
+	Stats stats() {
+		Stats s;
+		s.sleep_granularity_ms = sleep_granularity_ms;
+		s.missed_deadlines = missed_deadlines;
+		s.worst_overshoot_ms = worst_overshoot_ms;
+		s.dropped_updates = dropped_updates;
+		return s;
 	}
 }
 
@@ -171,6 +1534,7 @@ namespace Time {
 	float delta_time = 0.0f;
 	float delta_time_fixed = 0.0f;
 	float delta_time_raw = 0.0f;
+	float alpha = 1.0f;
 }
 
 namespace Input {
@@ -321,6 +1685,7 @@ namespace Scenes {
 	}
 
 	void update() {
+		PROFILE_SCOPE("scene update");
 		ASSERT_WITH_MSG(current_scene != nullptr, "current scene is null in update");
 		current_scene->update();
 	}
@@ -332,6 +1697,7 @@ namespace Scenes {
 	}
 
 	void render() {
+		PROFILE_SCOPE("scene render");
 	 	ASSERT_WITH_MSG(current_scene != nullptr, "current scene is null in render");
 	 	current_scene->render();
 	}
@@ -543,9 +1909,284 @@ namespace Noise {
 	float simplex(float x, float y) {
 		return SingleSimplex(0, x * m_frequency, y * m_frequency);
 	}
+
+	// every octave uses another part of the permutation so they don't line up
+	static float SingleFractal(Type type, float x, float y, int octaves, float lacunarity, float gain) {
+		auto single = type == PerlinFractal ? SinglePerlin : SingleSimplex;
+		float sum = single(m_perm[0], x, y);
+		float amp = 1;
+		float bounding = 1;
+		for(int i = 1; i < octaves; i++) {
+			x *= lacunarity;
+			y *= lacunarity;
+			amp *= gain;
+			bounding += amp;
+			sum += single(m_perm[i], x, y) * amp;
+		}
+		return sum / bounding;
+	}
+
+	float perlin_fractal(float x, float y, int octaves, float lacunarity, float gain) {
+		return SingleFractal(PerlinFractal, x * m_frequency, y * m_frequency, octaves, lacunarity, gain);
+	}
+
+	float simplex_fractal(float x, float y, int octaves, float lacunarity, float gain) {
+		return SingleFractal(SimplexFractal, x * m_frequency, y * m_frequency, octaves, lacunarity, gain);
+	}
+
+	static float Single(const Grid &settings, float x, float y) {
+		switch(settings.type) {
+			case Perlin: return SinglePerlin(0, x, y);
+			case Simplex: return SingleSimplex(0, x, y);
+			default: return SingleFractal(settings.type, x, y, settings.octaves, settings.lacunarity, settings.gain);
+		}
+	}
+
+	void grid_scalar(const Grid &settings, float *out) {
+		for(int row = 0; row < settings.height; row++) {
+			const float y = (settings.y + (float)row * settings.step) * m_frequency;
+			for(int column = 0; column < settings.width; column++) {
+				const float x = (settings.x + (float)column * settings.step) * m_frequency;
+				*out++ = Single(settings, x, y);
+			}
+		}
+	}
+
+	// Four samples side by side, the math is done in the same order as the
+	// single sample versions so the results are the same. SSE2 has no gather
+	// so the permutation lookups are still done one lane at a time.
+	static inline __m128i FastFloor4(__m128 f) {
+		// the compare is -1 in negative lanes, same as FastFloor
+		return _mm_add_epi32(_mm_cvttps_epi32(f), _mm_castps_si128(_mm_cmplt_ps(f, _mm_setzero_ps())));
+	}
+	static inline __m128 Lerp4(__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a))); }
+	static inline __m128 InterpHermiteFunc4(__m128 t) {
+		return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3), _mm_mul_ps(_mm_set1_ps(2), t)));
+	}
+	static inline __m128 InterpQuinticFunc4(__m128 t) {
+		__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10));
+		return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+	}
+
+	static inline __m128 Grad4(const float *gx, const float *gy, __m128 xd, __m128 yd) {
+		return _mm_add_ps(_mm_mul_ps(xd, _mm_load_ps(gx)), _mm_mul_ps(yd, _mm_load_ps(gy)));
+	}
+
+	static inline __m128 GradCoord2D4(unsigned char offset, __m128i x, __m128i y, __m128 xd, __m128 yd) {
+		alignas(16) int xs[4];
+		alignas(16) int ys[4];
+		alignas(16) float gx[4];
+		alignas(16) float gy[4];
+		_mm_store_si128((__m128i*)xs, x);
+		_mm_store_si128((__m128i*)ys, y);
+		for(int lane = 0; lane < 4; lane++) {
+			unsigned char lutPos = Index2D_12(offset, xs[lane], ys[lane]);
+			gx[lane] = GRAD_X[lutPos];
+			gy[lane] = GRAD_Y[lutPos];
+		}
+		return Grad4(gx, gy, xd, yd);
+	}
+
+	static __m128 SinglePerlin4(unsigned char offset, __m128 x, __m128 y) {
+		const __m128 one = _mm_set1_ps(1);
+		__m128i x0 = FastFloor4(x);
+		__m128i y0 = FastFloor4(y);
+		__m128 xd0 = _mm_sub_ps(x, _mm_cvtepi32_ps(x0));
+		__m128 yd0 = _mm_sub_ps(y, _mm_cvtepi32_ps(y0));
+		__m128 xd1 = _mm_sub_ps(xd0, one);
+		__m128 yd1 = _mm_sub_ps(yd0, one);
+
+		__m128 xs = xd0, ys = yd0;
+		switch (m_interp)
+		{
+		case Linear:
+			break;
+		case Hermite:
+			xs = InterpHermiteFunc4(xd0);
+			ys = InterpHermiteFunc4(yd0);
+			break;
+		case Quintic:
+			xs = InterpQuinticFunc4(xd0);
+			ys = InterpQuinticFunc4(yd0);
+			break;
+		}
+
+		// all four corners looked up in one pass
+		alignas(16) int x0s[4];
+		alignas(16) int y0s[4];
+		alignas(16) float gx[4][4];
+		alignas(16) float gy[4][4];
+		_mm_store_si128((__m128i*)x0s, x0);
+		_mm_store_si128((__m128i*)y0s, y0);
+		for(int lane = 0; lane < 4; lane++) {
+			const int perm_y0 = m_perm[(y0s[lane] & 0xff) + offset];
+			const int perm_y1 = m_perm[((y0s[lane] + 1) & 0xff) + offset];
+			const int px0 = x0s[lane] & 0xff;
+			const int px1 = (x0s[lane] + 1) & 0xff;
+			const unsigned char lut[4] = { m_perm12[px0 + perm_y0], m_perm12[px1 + perm_y0], m_perm12[px0 + perm_y1], m_perm12[px1 + perm_y1] };
+			for(int corner = 0; corner < 4; corner++) {
+				gx[corner][lane] = GRAD_X[lut[corner]];
+				gy[corner][lane] = GRAD_Y[lut[corner]];
+			}
+		}
+		__m128 xf0 = Lerp4(Grad4(gx[0], gy[0], xd0, yd0), Grad4(gx[1], gy[1], xd1, yd0), xs);
+		__m128 xf1 = Lerp4(Grad4(gx[2], gy[2], xd0, yd1), Grad4(gx[3], gy[3], xd1, yd1), xs);
+
+		return Lerp4(xf0, xf1, ys);
+	}
+
+	static inline __m128 SimplexCorner4(unsigned char offset, __m128i i, __m128i j, __m128 x, __m128 y) {
+		__m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+		__m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+		t = _mm_mul_ps(t, t);
+		__m128 n = _mm_mul_ps(_mm_mul_ps(t, t), GradCoord2D4(offset, i, j, x, y));
+		return _mm_and_ps(inside, n);
+	}
+
+	static __m128 SingleSimplex4(unsigned char offset, __m128 x, __m128 y) {
+		const __m128 one = _mm_set1_ps(1);
+		const __m128 g2 = _mm_set1_ps(G2);
+		__m128 t = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+		__m128i i = FastFloor4(_mm_add_ps(x, t));
+		__m128i j = FastFloor4(_mm_add_ps(y, t));
+
+		t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), g2);
+		__m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+		__m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+		// lower or upper triangle
+		__m128 lower = _mm_cmpgt_ps(x0, y0);
+		__m128i i1 = _mm_and_si128(_mm_castps_si128(lower), _mm_set1_epi32(1));
+		__m128i j1 = _mm_andnot_si128(_mm_castps_si128(lower), _mm_set1_epi32(1));
+
+		__m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), g2);
+		__m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), g2);
+		__m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2*G2));
+		__m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2*G2));
+
+		__m128 n0 = SimplexCorner4(offset, i, j, x0, y0);
+		__m128 n1 = SimplexCorner4(offset, _mm_add_epi32(i, i1), _mm_add_epi32(j, j1), x1, y1);
+		__m128 n2 = SimplexCorner4(offset, _mm_add_epi32(i, _mm_set1_epi32(1)), _mm_add_epi32(j, _mm_set1_epi32(1)), x2, y2);
+
+		return _mm_mul_ps(_mm_set1_ps(70), _mm_add_ps(_mm_add_ps(n0, n1), n2));
+	}
+
+	static __m128 Single4(const Grid &settings, __m128 x, __m128 y) {
+		if(settings.type == Perlin) {
+			return SinglePerlin4(0, x, y);
+		} else if(settings.type == Simplex) {
+			return SingleSimplex4(0, x, y);
+		}
+		auto single = settings.type == PerlinFractal ? SinglePerlin4 : SingleSimplex4;
+		const __m128 lacunarity = _mm_set1_ps(settings.lacunarity);
+		__m128 sum = single(m_perm[0], x, y);
+		float amp = 1;
+		float bounding = 1;
+		for(int i = 1; i < settings.octaves; i++) {
+			x = _mm_mul_ps(x, lacunarity);
+			y = _mm_mul_ps(y, lacunarity);
+			amp *= settings.gain;
+			bounding += amp;
+			sum = _mm_add_ps(sum, _mm_mul_ps(single(m_perm[i], x, y), _mm_set1_ps(amp)));
+		}
+		return _mm_div_ps(sum, _mm_set1_ps(bounding));
+	}
+
+	static void grid_rows(const Grid &settings, float *out, int row_begin, int row_end) {
+		const __m128 origin_x = _mm_set1_ps(settings.x);
+		const __m128 step = _mm_set1_ps(settings.step);
+		const __m128 frequency = _mm_set1_ps(m_frequency);
+		const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+		for(int row = row_begin; row < row_end; row++) {
+			const float y = (settings.y + (float)row * settings.step) * m_frequency;
+			const __m128 y4 = _mm_set1_ps(y);
+			float *row_out = out + (size_t)row * settings.width;
+			int column = 0;
+			for(; column + 4 <= settings.width; column += 4) {
+				__m128 columns = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(column), lanes));
+				__m128 x4 = _mm_mul_ps(_mm_add_ps(origin_x, _mm_mul_ps(columns, step)), frequency);
+				_mm_storeu_ps(row_out + column, Single4(settings, x4, y4));
+			}
+			for(; column < settings.width; column++) {
+				const float x = (settings.x + (float)column * settings.step) * m_frequency;
+				row_out[column] = Single(settings, x, y);
+			}
+		}
+	}
+
+	void grid(const Grid &settings, float *out) {
+		const int workers = settings.threaded ? Jobs::thread_count() : 0;
+		// not worth handing out less than this
+		const int min_band_rows = 16;
+		if(workers == 0 || settings.height < min_band_rows * 2) {
+			grid_rows(settings, out, 0, settings.height);
+			return;
+		}
+
+		int bands = std::min(workers + 1, settings.height / min_band_rows);
+		int band_rows = (settings.height + bands - 1) / bands;
+		std::atomic<int> remaining(bands - 1);
+		for(int band = 1; band < bands; band++) {
+			const int row_begin = band * band_rows;
+			const int row_end = std::min(row_begin + band_rows, settings.height);
+			Jobs::submit([&settings, out, row_begin, row_end, &remaining]() {
+				grid_rows(settings, out, row_begin, row_end);
+				remaining.fetch_sub(1, std::memory_order_release);
+			});
+		}
+		// this thread does the first band instead of waiting
+		grid_rows(settings, out, 0, std::min(band_rows, settings.height));
+		while(remaining.load(std::memory_order_acquire) > 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	// whole cache is dropped past this, grids handed out stay alive through their shared_ptr
+	const size_t GRID_CACHE_MAX_FLOATS = 4 * 1024 * 1024;
+	typedef std::tuple<int, int, float, float, float, int, int, int, float, float> GridKey;
+	static std::map<GridKey, std::shared_ptr<const std::vector<float>>> m_grid_cache;
+	static size_t m_grid_cache_floats = 0;
+
+	std::shared_ptr<const std::vector<float>> grid_cached(const Grid &settings) {
+		// fractal settings are left out for the single octave types so they don't split the cache
+		const bool fractal = settings.type == PerlinFractal || settings.type == SimplexFractal;
+		GridKey key(m_seed, (int)settings.type, settings.x, settings.y, settings.step, settings.width, settings.height,
+			fractal ? settings.octaves : 0, fractal ? settings.lacunarity : 0, fractal ? settings.gain : 0);
+		auto it = m_grid_cache.find(key);
+		if(it != m_grid_cache.end()) {
+			return it->second;
+		}
+
+		const size_t floats = (size_t)settings.width * settings.height;
+		if(m_grid_cache_floats + floats > GRID_CACHE_MAX_FLOATS) {
+			cache_clear();
+		}
+		auto values = std::make_shared<std::vector<float>>(floats);
+		grid(settings, values->data());
+		m_grid_cache[key] = values;
+		m_grid_cache_floats += floats;
+		return values;
+	}
+
+	void cache_clear() {
+		m_grid_cache.clear();
+		m_grid_cache_floats = 0;
+	}
 }
 
 namespace Tiling {
+	struct TileMapHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t layers;
+		uint32_t columns;
+		uint32_t rows;
+		uint32_t tile_size;
+	};
+	const uint32_t TILEMAP_MAGIC = 0x31424D54; // TMB1
+	const uint32_t TILEMAP_VERSION = 1;
+	static_assert(sizeof(unsigned) == sizeof(uint32_t), "binary tile maps store tiles as uint32");
+
     unsigned tilemap_index(const TileMap &tile_map, const unsigned layer, const unsigned x, const unsigned y) {
         int layer_start = layer * tile_map.columns * tile_map.rows;
         return layer_start + y*tile_map.columns+x;
@@ -556,17 +2197,20 @@ namespace Tiling {
         std::ifstream tile_map_stream(map_name);
         
         if(tile_map_stream) {
+            tilemap_free(tile_map);
             tile_map_stream >> tile_map.layers;
             tile_map_stream >> tile_map.columns;
             tile_map_stream >> tile_map.rows;
             tile_map_stream >> tile_map.tile_size;
             unsigned tile_count = tile_map.layers * tile_map.columns * tile_map.rows;
             tile_map.tiles = new unsigned[tile_count];
-            for(unsigned layer = 1; layer <= tile_map.layers; layer++) {
-                for(unsigned i = 0; i < tile_map.columns * tile_map.rows; i++) {
-                    int tile;
-                    tile_map_stream >> tile;
-                    tile_map.tiles[tile_map.layers * i] = tile;
+            for(unsigned layer = 0; layer < tile_map.layers; layer++) {
+                for(unsigned y = 0; y < tile_map.rows; y++) {
+                    for(unsigned x = 0; x < tile_map.columns; x++) {
+                        int tile;
+                        tile_map_stream >> tile;
+                        tile_map.tiles[tilemap_index(tile_map, layer, x, y)] = tile;
+                    }
                 }
             }
         } else {
@@ -574,7 +2218,47 @@ namespace Tiling {
         }
     }
 
+    bool tilemap_load_binary(const std::string file, TileMap &tile_map) {
+        std::string map_name = Engine::get_base_data_folder() + file;
+        MappedFile mapped;
+        if(!Files::map(map_name, mapped)) {
+            Engine::logn("[WARNING] unable to open tilemap file %s", map_name.c_str());
+            return false;
+        }
+
+        const TileMapHeader *header = (const TileMapHeader*)mapped.data;
+        if(mapped.size < sizeof(TileMapHeader) || header->magic != TILEMAP_MAGIC || header->version != TILEMAP_VERSION
+            || mapped.size != sizeof(TileMapHeader) + (size_t)header->layers * header->columns * header->rows * sizeof(uint32_t)) {
+            Engine::logn("[WARNING] %s is not a valid tilemap", map_name.c_str());
+            Files::unmap(mapped);
+            return false;
+        }
+
+        tilemap_free(tile_map);
+        tile_map.layers = header->layers;
+        tile_map.columns = header->columns;
+        tile_map.rows = header->rows;
+        tile_map.tile_size = header->tile_size;
+        tile_map.tiles = (unsigned*)(mapped.data + sizeof(TileMapHeader));
+        tile_map.mapped = mapped;
+        return true;
+    }
+
+    bool tilemap_save_binary(const std::string file, const TileMap &tile_map) {
+        std::string map_name = Engine::get_base_data_folder() + file;
+        std::ofstream out(map_name, std::ios::binary | std::ios::trunc);
+        if(!out) {
+            Engine::logn("[WARNING] unable to write tilemap %s", map_name.c_str());
+            return false;
+        }
+        TileMapHeader header = { TILEMAP_MAGIC, TILEMAP_VERSION, tile_map.layers, tile_map.columns, tile_map.rows, tile_map.tile_size };
+        out.write((const char*)&header, sizeof(TileMapHeader));
+        out.write((const char*)tile_map.tiles, (size_t)tile_map.layers * tile_map.columns * tile_map.rows * sizeof(uint32_t));
+        return true;
+    }
+
 	void tilemap_make(TileMap &tile_map, unsigned layers, unsigned columns, unsigned rows, unsigned tile_size, unsigned default_tile) {
+        tilemap_free(tile_map);
         tile_map.layers = layers;
         tile_map.columns = columns;
         tile_map.rows = rows;
@@ -582,11 +2266,30 @@ namespace Tiling {
         unsigned tile_count = tile_map.layers * tile_map.columns * tile_map.rows;
 		Engine::log("tile_count: %d", tile_count);
         tile_map.tiles = new unsigned[tile_count];
-        for(unsigned layer = 1; layer <= tile_map.layers; layer++) {
-            for(unsigned i = 0; i < tile_map.columns * tile_map.rows; i++) {
-                tile_map.tiles[tile_map.layers * i] = default_tile;
-            }
+        std::fill(tile_map.tiles, tile_map.tiles + tile_count, default_tile);
+    }
+
+    void tilemap_set(TileMap &tile_map, const unsigned layer, const unsigned x, const unsigned y, const unsigned tile) {
+        if(tile_map.mapped.data != NULL) {
+            // mapped read only, take a copy before the first change
+            unsigned tile_count = tile_map.layers * tile_map.columns * tile_map.rows;
+            unsigned *tiles = new unsigned[tile_count];
+            std::copy(tile_map.tiles, tile_map.tiles + tile_count, tiles);
+            Files::unmap(tile_map.mapped);
+            tile_map.mapped = MappedFile();
+            tile_map.tiles = tiles;
+        }
+        tile_map.tiles[tilemap_index(tile_map, layer, x, y)] = tile;
+    }
+
+    void tilemap_free(TileMap &tile_map) {
+        if(tile_map.mapped.data != NULL) {
+            Files::unmap(tile_map.mapped);
+            tile_map.mapped = MappedFile();
+        } else {
+            delete[] tile_map.tiles;
         }
+        tile_map.tiles = NULL;
     }
 }
 
@@ -2,10 +2,64 @@
 #define ENGINE_H
 
 #include "precompiled.h"
+#include "files.h"
+
+#include <atomic>
+
+// Messages are formatted into a lock free ring and a background thread writes
+// them to stdout or a file, so logging never waits on the output. Levels below
+// LOG_MIN_LEVEL and categories outside LOG_CATEGORIES compile to nothing.
+// Each call site gets LOG_RATE_LIMIT messages a second, the rest are counted
+// and reported. Asserts and crashes flush what is queued before the process ends.
+namespace Log {
+	enum Level { Trace, Debug, Info, Warning, Error };
+	enum Category : uint32_t {
+		General = 1 << 0,
+		Render = 1 << 1,
+		Battle = 1 << 2,
+		Map = 1 << 3,
+		Sound = 1 << 4,
+		Resources = 1 << 5
+	};
+
+	// null writes to stdout, can be called again to change the output
+	void init(const char *path = nullptr);
+	// writes everything queued and stops the writer thread, later messages are written right away
+	void shutdown();
+	// returns when everything queued before the call is written
+	void flush();
+	void write(Level level, uint32_t category, const char *fmt, ...);
+	void write_va(Level level, uint32_t category, bool newline, const char *fmt, va_list args);
+	// messages lost because the ring was full
+	uint32_t dropped();
+}
+
+#ifndef LOG_MIN_LEVEL
+#ifdef _DEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 2
+#endif
+#endif
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES 0xffffffffu
+#endif
+#ifndef LOG_RATE_LIMIT
+#define LOG_RATE_LIMIT 20
+#endif
+
+#define LOG_AT(level, category, ...) do { \
+	if((int)(level) >= LOG_MIN_LEVEL && ((category) & LOG_CATEGORIES) != 0) { Log::write(level, category, __VA_ARGS__); } \
+} while(0)
+#define LOG_TRACE(category, ...) LOG_AT(Log::Trace, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(Log::Debug, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(Log::Info, category, __VA_ARGS__)
+#define LOG_WARNING(category, ...) LOG_AT(Log::Warning, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(Log::Error, category, __VA_ARGS__)
 
 #ifdef _DEBUG
 #define ASSERT_WITH_MSG(cond, msg) do \
-{ if (!(cond)) { std::ostringstream str; str << msg; std::cerr << str.str(); std::abort(); } \
+{ if (!(cond)) { Log::flush(); std::ostringstream str; str << msg; std::cerr << str.str(); std::abort(); } \
 } while(0)
 #else 
 #define ASSERT_WITH_MSG(cond, msg) ;
@@ -70,6 +124,220 @@ namespace Engine {
 	void cleanup();
 }
 
+// Limits the main loop to a target fps, sleeps with SDL_Delay for most of the
+// frame and spins the rest since the os sleep is only as precise as its
+// measured granularity. A target of 0 runs unlimited.
+namespace FramePacer {
+	struct Stats {
+		float sleep_granularity_ms = 0;
+		// frames that finished later than their deadline by more than a frame
+		uint32_t missed_deadlines = 0;
+		float worst_overshoot_ms = 0;
+		// fixed updates thrown away by the catch up cap
+		uint32_t dropped_updates = 0;
+	};
+
+	// not thread safe, call before the loop starts
+	void init(int target_fps);
+	// safe from any thread, takes effect at the next wait()
+	void set_target_fps(int fps);
+	int target_fps();
+	int default_target_fps();
+	// call once per rendered frame, returns when the next frame should start
+	void wait();
+	void drop_updates(uint32_t count);
+	// copy, the counters are updated from other threads
+	Stats stats();
+}
+
+// Fixed pool of worker threads for background work like generating map chunks.
+// Jobs run in submit order but several at once, they must not touch SDL rendering.
+// Started on the first submit, stopped by Engine::cleanup.
+namespace Jobs {
+	// 0 uses one less than the hardware threads, at least one
+	void init(int threads = 0);
+	void shutdown();
+	void submit(std::function<void()> job);
+	int thread_count();
+	// queued and running
+	size_t pending();
+	void wait_idle();
+}
+
+// Scoped timing zones, PROFILE_SCOPE("name") times until the end of the block.
+// Every thread writes to its own ring that frame() drains, nothing is locked
+// while recording and a disabled profiler costs one branch per zone.
+// Define PROFILER_DISABLED to compile the zones out.
+namespace Profiler {
+	extern std::atomic<bool> _enabled;
+
+	struct Scope {
+		const char *name;
+		uint64_t start;
+		// allocations are counted against the innermost zone
+		const char *previous_label;
+
+		explicit Scope(const char *zone_name) : name(zone_name), start(0) {
+			if(_enabled.load(std::memory_order_relaxed)) {
+				begin();
+			}
+		}
+		~Scope() {
+			if(start != 0) {
+				end();
+			}
+		}
+		void begin();
+		void end();
+	};
+
+	// min, mean and max of the time spent in the zone per frame, over the last second
+	struct ZoneStats {
+		const char *name;
+		int depth;
+		uint32_t calls;
+		float min_ms;
+		float mean_ms;
+		float max_ms;
+	};
+
+	// per zone stats and the overlay
+	void set_enabled(bool enabled);
+	bool is_enabled();
+	// shows up as the thread name in captures
+	void set_thread_name(const char *name);
+	const char *thread_name(int thread);
+	// gets every zone as frame drains it, zones are recorded while it is set
+	typedef void (*ZoneListener)(const char *name, uint64_t start, uint64_t end, int thread);
+	void set_listener(ZoneListener listener);
+	// call once per rendered frame outside of any zone
+	void frame();
+	// parents before their children
+	const std::vector<ZoneStats> &zone_stats();
+	// records the next frames and writes them as chrome trace json (chrome://tracing)
+	void capture(int frames, const std::string &path);
+	bool is_capturing();
+}
+
+// Counts every global operator new while enabled, in total, per frame and per
+// label. The label is the innermost profiler zone while the profiler records,
+// or the innermost ALLOCATION_TAG("name"). Labels are matched by pointer so
+// use literals. Define ALLOCATION_TRACKING_DISABLED to keep the default operators.
+namespace Allocations {
+	const int MAX_LABELS = 64;
+
+	struct Counts {
+		uint64_t count;
+		uint64_t bytes;
+	};
+
+	struct LabelCounts {
+		const char *name;
+		Counts counts;
+	};
+
+	struct Tag {
+		const char *previous;
+		explicit Tag(const char *name);
+		~Tag();
+	};
+
+	void set_enabled(bool enabled);
+	bool is_enabled();
+	// called by operator new
+	void record(size_t bytes);
+	// swaps the current label, returns the one it replaced
+	const char *label_swap(const char *name);
+
+	// since the last reset
+	Counts total();
+	// most allocations first, returns how many were written
+	int labels(LabelCounts *out, int max);
+	void reset();
+
+	// call once per frame, last_frame is what was allocated since the previous call
+	void frame();
+	const Counts &last_frame();
+	int last_frame_labels(LabelCounts *out, int max);
+}
+
+// Keeps the last seconds of frames with their zones, update times and counters
+// in fixed rings. A frame slower than the threshold writes the window to
+// spike_<date>_<time>.json (chrome trace format), at most once per window.
+// Called from the thread that renders.
+namespace FlightRecorder {
+	const int MAX_COUNTERS = 16;
+
+	void enable(float seconds, float threshold_ms);
+	void disable();
+	bool is_enabled();
+	void frame_begin();
+	void frame_end();
+	// time taken by one fixed update
+	void add_update(uint64_t ticks);
+	// value for this frame and the next ones until it is set again
+	void counter(const char *name, int64_t value);
+	void dump(const char *reason);
+}
+
+// Numbers overlay with fixed storage, nothing allocates after the first use of
+// a name. Frame, update and render times go into rings with a histogram kept
+// next to them so percentiles are a walk over the bins.
+namespace PerfHud {
+	enum Timing { Frame, Update, Render, TimingCount };
+
+	const int MAX_VALUES = 24;
+	const int HISTORY = 256;
+	const float BIN_MS = 0.1f;
+	const int BINS = 500;
+
+	struct TimingHistory {
+		float samples[HISTORY];
+		// total written, the newest sample is at (written - 1) % HISTORY
+		uint32_t written;
+		// last bin counts everything above BINS * BIN_MS
+		uint16_t bins[BINS + 1];
+	};
+
+	struct Percentiles {
+		float p50;
+		float p95;
+		float p99;
+	};
+
+	struct Value {
+		const char *name;
+		bool is_gauge;
+		int64_t counter;
+		float gauge;
+	};
+
+	void set_enabled(bool enabled);
+	bool is_enabled();
+	void add_timing(Timing timing, float ms);
+	// ticks spent drawing the hud, left out of the render time
+	void exclude(uint64_t ticks);
+	uint64_t excluded();
+	// names have to outlive the hud, use literals
+	void counter(const char *name, int64_t value);
+	void gauge(const char *name, float value);
+
+	const TimingHistory &history(Timing timing);
+	// upper edge of the bin, BIN_MS resolution
+	Percentiles percentiles(Timing timing);
+	int value_count();
+	const Value &value(int index);
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(_profile_scope_, __LINE__)(name)
+#endif
+#define ALLOCATION_TAG(name) Allocations::Tag PROFILE_CONCAT(_allocation_tag_, __LINE__)(name)
+
 struct Point;
 namespace FrameLog {
 	const bool &is_enabled();
@@ -313,6 +581,8 @@ namespace Time {
 	extern float delta_time;
 	extern float delta_time_fixed;
 	extern float delta_time_raw;
+	// how far render is between the last two fixed updates (0 - 1), used to interpolate
+	extern float alpha;
 }
 
 namespace Input {
@@ -732,6 +1002,30 @@ namespace RNG {
     Iter select_randomly(Iter start, Iter end) {
         return select_randomly(start, end, RNG_generator);
     }
+
+    // xorshift32, much cheaper than mt19937 and gives the same sequence on every
+    // platform through next_below (the std distributions are implementation defined)
+    // Can also be passed as the generator to range_i/range_f and friends.
+    struct Fast {
+        typedef uint32_t result_type;
+        uint32_t state;
+
+        Fast(uint32_t seed = 1) { set_seed(seed); }
+        void set_seed(uint32_t seed) { state = seed != 0 ? seed : 0x9E3779B9; }
+
+        uint32_t next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+        // [0, n)
+        uint32_t next_below(uint32_t n) { return (uint32_t)(((uint64_t)next() * n) >> 32); }
+
+        static constexpr uint32_t min() { return 1; }
+        static constexpr uint32_t max() { return 0xFFFFFFFF; }
+        uint32_t operator()() { return next(); }
+    };
 }
 
 namespace Localization {
@@ -760,20 +1054,58 @@ namespace Noise {
 	void set_seed(int seed);	
 	float perlin(float x, float y);
 	float simplex(float x, float y);
+	// fractal brownian motion, octaves layered at lacunarity times the frequency and gain times the amplitude
+	float perlin_fractal(float x, float y, int octaves = 3, float lacunarity = 2.0f, float gain = 0.5f);
+	float simplex_fractal(float x, float y, int octaves = 3, float lacunarity = 2.0f, float gain = 0.5f);
+
+	enum Type { Perlin, Simplex, PerlinFractal, SimplexFractal };
+
+	// Sample (x + column * step, y + row * step) for every cell, same coordinates as perlin/simplex
+	struct Grid {
+		Type type = Perlin;
+		float x = 0;
+		float y = 0;
+		float step = 1;
+		int width = 0;
+		int height = 0;
+		int octaves = 3;
+		float lacunarity = 2.0f;
+		float gain = 0.5f;
+		// split the rows over the Jobs workers
+		bool threaded = false;
+	};
+
+	// Fills out (width * height floats, row by row) four samples at a time with SSE2,
+	// gives the same values as calling the single sample functions
+	void grid(const Grid &settings, float *out);
+	// Same as grid but without SSE2, for checking and for comparison
+	void grid_scalar(const Grid &settings, float *out);
+	// Cached by seed and settings, made with grid the first time
+	std::shared_ptr<const std::vector<float>> grid_cached(const Grid &settings);
+	void cache_clear();
 }
 
+// Tiles are stored layer by layer, each layer row by row (see tilemap_index)
 struct TileMap {
 	unsigned tile_size;
 	unsigned columns;
 	unsigned rows;
 	unsigned layers;
-	unsigned *tiles;
+	unsigned *tiles = NULL;
+	// set when tiles point into a mapped binary map, tilemap_set copies them out first
+	MappedFile mapped;
 };
 
 namespace Tiling {
 	unsigned tilemap_index(const TileMap &tile_map, const unsigned layer, const unsigned x, const unsigned y);
+	// text format: layers columns rows tile_size followed by the tiles of each layer
 	void tilemap_load(const std::string map_name, TileMap &tile_map);
+	// binary format: TileMapHeader followed by the uint32 tiles of each layer, mapped in place
+	bool tilemap_load_binary(const std::string map_name, TileMap &tile_map);
+	bool tilemap_save_binary(const std::string map_name, const TileMap &tile_map);
 	void tilemap_make(TileMap &tile_map, unsigned layers, unsigned columns, unsigned rows, unsigned tile_size, unsigned default_tile = 0);
+	void tilemap_set(TileMap &tile_map, const unsigned layer, const unsigned x, const unsigned y, const unsigned tile);
+	void tilemap_free(TileMap &tile_map);
 };
 
 namespace Sound {
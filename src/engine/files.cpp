@@ -0,0 +1,174 @@
+#include "files.h"
+#include "engine.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#define NOGDI
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+#endif
+
+namespace Files {
+#ifdef _WIN32
+	bool map(const std::string &path, MappedFile &file) {
+		file = MappedFile();
+		HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(handle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+			CloseHandle(handle);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(mapping == NULL) {
+			CloseHandle(handle);
+			return false;
+		}
+
+		void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if(data == NULL) {
+			CloseHandle(mapping);
+			CloseHandle(handle);
+			return false;
+		}
+
+		file.data = (const char*)data;
+		file.size = (size_t)size.QuadPart;
+		file.handle = handle;
+		file.mapping = mapping;
+		return true;
+	}
+
+	void unmap(MappedFile &file) {
+		if(file.data != NULL) {
+			UnmapViewOfFile(file.data);
+			CloseHandle((HANDLE)file.mapping);
+			CloseHandle((HANDLE)file.handle);
+		}
+		file = MappedFile();
+	}
+#else
+	bool map(const std::string &path, MappedFile &file) {
+		file = MappedFile();
+		int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) {
+			return false;
+		}
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			return false;
+		}
+
+		void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping stays valid after the descriptor is closed
+		close(fd);
+		if(data == MAP_FAILED) {
+			return false;
+		}
+
+		file.data = (const char*)data;
+		file.size = (size_t)st.st_size;
+		return true;
+	}
+
+	void unmap(MappedFile &file) {
+		if(file.data != NULL) {
+			munmap((void*)file.data, file.size);
+		}
+		file = MappedFile();
+	}
+#endif
+
+	int64_t modified_time(const std::string &path) {
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0) {
+			return 0;
+		}
+		return (int64_t)st.st_mtime;
+	}
+
+	void watch_init(FileWatcher &watcher, const std::string &folder, const std::vector<std::string> &files) {
+		ASSERT_WITH_MSG(files.size() <= 32, "Files::watch_init, max 32 files");
+		watch_close(watcher);
+		watcher.folder = folder;
+		watcher.files = files;
+		watcher.modified.clear();
+		for(auto &f : files) {
+			watcher.modified.push_back(modified_time(folder + f));
+		}
+		watcher.last_check = SDL_GetTicks();
+
+#ifdef __linux__
+		watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(watcher.fd >= 0 && inotify_add_watch(watcher.fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			close(watcher.fd);
+			watcher.fd = -1;
+		}
+#endif
+	}
+
+	uint32_t watch_poll(FileWatcher &watcher) {
+		uint32_t changed = 0;
+
+#ifdef __linux__
+		if(watcher.fd >= 0) {
+			alignas(struct inotify_event) char buffer[4096];
+			ssize_t length;
+			while((length = read(watcher.fd, buffer, sizeof(buffer))) > 0) {
+				for(char *p = buffer; p < buffer + length; ) {
+					struct inotify_event *event = (struct inotify_event*)p;
+					if(event->len > 0) {
+						for(size_t i = 0; i < watcher.files.size(); i++) {
+							if(watcher.files[i] == event->name) {
+								changed |= 1u << i;
+							}
+						}
+					}
+					p += sizeof(struct inotify_event) + event->len;
+				}
+			}
+			return changed;
+		}
+#endif
+
+		uint32_t now = SDL_GetTicks();
+		if(now - watcher.last_check < 1000) {
+			return 0;
+		}
+		watcher.last_check = now;
+		for(size_t i = 0; i < watcher.files.size(); i++) {
+			int64_t time = modified_time(watcher.folder + watcher.files[i]);
+			if(time != watcher.modified[i]) {
+				watcher.modified[i] = time;
+				changed |= 1u << i;
+			}
+		}
+		return changed;
+	}
+
+	void watch_close(FileWatcher &watcher) {
+#ifdef __linux__
+		if(watcher.fd >= 0) {
+			close(watcher.fd);
+		}
+#endif
+		watcher.fd = -1;
+	}
+}
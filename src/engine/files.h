@@ -0,0 +1,38 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Read only view of a whole file, kept valid until unmap
+struct MappedFile {
+    const char *data = NULL;
+    size_t size = 0;
+    void *handle = NULL;
+    void *mapping = NULL;
+};
+
+// Reports which of a few files in a folder changed since the last poll.
+// Uses inotify on linux, elsewhere modification times are compared at most once a second.
+struct FileWatcher {
+    std::string folder;
+    std::vector<std::string> files;
+    std::vector<int64_t> modified;
+    uint32_t last_check = 0;
+    int fd = -1;
+};
+
+namespace Files {
+    bool map(const std::string &path, MappedFile &file);
+    void unmap(MappedFile &file);
+    // Last modification time in seconds, 0 if the file does not exist
+    int64_t modified_time(const std::string &path);
+
+    void watch_init(FileWatcher &watcher, const std::string &folder, const std::vector<std::string> &files);
+    // Bit i is set if files[i] changed, max 32 files
+    uint32_t watch_poll(FileWatcher &watcher);
+    void watch_close(FileWatcher &watcher);
+}
+
+#endif
@@ -2,5 +2,10 @@
 #define GAME_H
 
 void game_load();
+// runs the benchmarks in _benchmarks.h, returns non zero on failure
+// dump_folder is optional, when set the render benchmark saves frames as png
+int game_benchmark(const char *dump_folder);
+// streams an unbounded map instead of the fixed maze, call before game_load
+void game_set_infinite_map(bool enabled);
 
 #endif
\ No newline at end of file
@@ -12,11 +12,58 @@ Point east(1, 0);
 
 std::vector<Point> pointDirections = { north, south, east, west };
 
-void maze_generate(Maze &maze, int cols, int rows) {
-	Cell* cells = new Cell[cols*rows];
-	maze.buffer = cells;
+// direction from a cell to its neighbour and the opening on the other side
+static const Directions opposite[9] = { None, South, North, None, East, None, None, None, West };
+// number of open directions in a 4 bit mask
+static const uint8_t opening_count[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+// nth_opening[mask][n] is the nth lowest direction set in mask
+static const uint8_t nth_opening[16][4] = {
+	{ 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 2, 0, 0, 0 }, { 1, 2, 0, 0 },
+	{ 4, 0, 0, 0 }, { 1, 4, 0, 0 }, { 2, 4, 0, 0 }, { 1, 2, 4, 0 },
+	{ 8, 0, 0, 0 }, { 1, 8, 0, 0 }, { 2, 8, 0, 0 }, { 1, 2, 8, 0 },
+	{ 4, 8, 0, 0 }, { 1, 4, 8, 0 }, { 2, 4, 8, 0 }, { 1, 2, 4, 8 }
+};
+
+static Directions direction_to(int dx, int dy) {
+	if(dx == 0 && dy == -1) return North;
+	if(dx == 0 && dy == 1) return South;
+	if(dx == -1 && dy == 0) return West;
+	if(dx == 1 && dy == 0) return East;
+	return None;
+}
+
+static void maze_notify(Maze *maze, MazeChange::Type type, int x = 0, int y = 0, int x2 = 0, int y2 = 0) {
+	if(maze->on_change) {
+		maze->on_change(*maze, MazeChange { type, Point(x, y), Point(x2, y2) });
+	}
+}
+
+static size_t maze_openings_size(int cols, int rows) {
+	// padded so the bitmaps after it are 8 byte aligned
+	return ((((size_t)cols * rows + 1) / 2) + 7) & ~(size_t)7;
+}
+
+static size_t maze_bitmap_words(int cols, int rows) {
+	return ((size_t)cols * rows + 63) / 64;
+}
+
+size_t maze_data_size(int cols, int rows) {
+	return maze_openings_size(cols, rows) + maze_bitmap_words(cols, rows) * sizeof(uint64_t) * 2;
+}
+
+static void maze_allocate(Maze &maze, int cols, int rows) {
+	maze_free(&maze);
 	maze.cols = cols;
 	maze.rows = rows;
+	size_t words = maze_bitmap_words(cols, rows);
+	maze.data = (uint8_t*)new uint64_t[maze_data_size(cols, rows) / sizeof(uint64_t)]();
+	maze.buffer = maze.data;
+	maze.visited = (uint64_t*)(maze.data + maze_openings_size(cols, rows));
+	maze.completed = maze.visited + words;
+}
+
+void maze_generate(Maze &maze, int cols, int rows) {
+	maze_allocate(maze, cols, rows);
 }
 
 bool maze_connection_is_open(const Maze *maze, const Point start, const Point target) {
@@ -24,58 +71,35 @@ bool maze_connection_is_open(const Maze *maze, const Point start, const Point ta
 }
 
 bool maze_connection_is_open(const Maze *maze, const int x, const int y, const int x2, const int y2) {
-	Point direction(x2 - x, y2 - y);
-	
-	if(direction == north) {
-		return (maze->buffer[maze->index(x, y)].Openings & Directions::North) == Directions::North;
-	}
-	if(direction == south) {
-		return (maze->buffer[maze->index(x, y)].Openings & Directions::South) == Directions::South;
-	}
-	if(direction == west) {
-		return (maze->buffer[maze->index(x, y)].Openings & Directions::West) == Directions::West;
-	}
-	if(direction == east) {
-		return (maze->buffer[maze->index(x, y)].Openings & Directions::East) == Directions::East;
-	}
-
-	return false;
+	Directions direction = direction_to(x2 - x, y2 - y);
+	return direction != None && maze->is_open(x, y, direction);
 }
 
 void maze_close_all(Maze *maze) {
-	static const struct Cell UnconnectedCell;
-
-	for (int y = 0; y < maze->rows; y++) {
-        for (int x = 0; x < maze->cols; x++){
-			maze->buffer[maze->index(x,y)] = UnconnectedCell;
-		}
-	}
+	memset(maze->buffer, 0, maze_openings_size(maze->cols, maze->rows));
+	maze_notify(maze, MazeChange::All);
 }
 
 void maze_open_all(Maze *maze) {
-    static const struct Cell UnconnectedCell;
-
 	for (int y = 0; y < maze->rows; y++) {
         for (int x = 0; x < maze->cols; x++){
-            maze->buffer[maze->index(x,y)] = UnconnectedCell;
-
-			maze->buffer[maze->index(x,y)].IsLeftWallOpen = x > 0;
-            maze->buffer[maze->index(x,y)].IsTopWallOpen = y > 0;
-            
+			Directions d = None;
             if(x > 0) {
-                maze->buffer[maze->index(x,y)].Openings |= Directions::West;
+                d |= Directions::West;
             }
-            if(x < maze->cols) {
-                maze->buffer[maze->index(x,y)].Openings |= Directions::East;
+            if(x < maze->cols - 1) {
+                d |= Directions::East;
             }
             if(y > 0) {
-                maze->buffer[maze->index(x,y)].Openings |= Directions::North;
+                d |= Directions::North;
             }
-            if(y < maze->rows) {
-                maze->buffer[maze->index(x,y)].Openings |= Directions::South;
+            if(y < maze->rows - 1) {
+                d |= Directions::South;
             }
+			maze->set_openings(x, y, d);
 		}
 	}
+	maze_notify(maze, MazeChange::All);
 }
 
 void maze_close_connection(Maze *maze, Point start, Point target) {
@@ -83,24 +107,13 @@ void maze_close_connection(Maze *maze, Point start, Point target) {
 }
 
 void maze_close_connection(Maze *maze, int x, int y, int x2, int y2) {
-	Point direction(x2 - x, y2 - y);
-	
-	if(direction == north) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings & ~Directions::North;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings & ~Directions::South;
-	}
-	if(direction == south) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings & ~Directions::South;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings & ~Directions::North;
-	}
-	if(direction == west) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings & ~Directions::West;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings & ~Directions::East;
-	}
-	if(direction == east) {
-		maze->buffer[maze->index(x, y)].Openings &= ~Directions::East;
-		maze->buffer[maze->index(x2, y2)].Openings &= ~Directions::West;
+	Directions direction = direction_to(x2 - x, y2 - y);
+	if(direction == None) {
+		return;
 	}
+	maze->set_openings(x, y, maze->openings(x, y) & ~direction);
+	maze->set_openings(x2, y2, maze->openings(x2, y2) & ~opposite[direction]);
+	maze_notify(maze, MazeChange::Closed, x, y, x2, y2);
 }
 
 void maze_open_connection(Maze *maze, Point start, Point target) {
@@ -108,92 +121,174 @@ void maze_open_connection(Maze *maze, Point start, Point target) {
 }
 
 void maze_open_connection(Maze *maze, int x, int y, int x2, int y2) {
-	Point direction(x2 - x, y2 - y);
-	if(direction == north) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings | Directions::North;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings | Directions::South;
+	Directions direction = direction_to(x2 - x, y2 - y);
+	if(direction == None) {
+		return;
 	}
-	if(direction == south) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings | Directions::South;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings | Directions::North;
+	maze->set_openings(x, y, maze->openings(x, y) | direction);
+	maze->set_openings(x2, y2, maze->openings(x2, y2) | opposite[direction]);
+	maze_notify(maze, MazeChange::Opened, x, y, x2, y2);
+}
+
+// Reused between regions. Each region is grown in a byte grid with a one cell border,
+// low 4 bits are the openings and CARVED marks cells already in the tree. The border
+// starts carved so neighbours never need bounds checks.
+static const uint8_t CARVED = 0x10;
+
+struct GrowScratch {
+	std::vector<uint32_t> cells;
+	std::vector<uint8_t> grid;
+};
+
+static uint32_t region_seed(uint32_t seed, int x, int y) {
+	uint32_t h = seed * 3266489917u + 374761393u;
+	h = (h << 17) | (h >> 15);
+	h += (uint32_t)x * 3266489917u;
+	h = ((h << 17) | (h >> 15)) * 668265263u;
+	h += (uint32_t)y * 2246822519u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	h *= 3266489917u;
+	h ^= h >> 16;
+	return h;
+}
+
+static void open_towards(Maze *maze, int x, int y, Directions d) {
+	int x2 = x, y2 = y;
+	if(d == North) y2--;
+	else if(d == South) y2++;
+	else if(d == West) x2--;
+	else x2++;
+	maze->set_openings(x, y, maze->openings(x, y) | d);
+	maze->set_openings(x2, y2, maze->openings(x2, y2) | opposite[d]);
+}
+
+// Growing tree over the region, every cell in it ends up connected exactly once
+static void grow_tree_region(Maze *maze, const int x0, const int y0, const int w, const int h, const MazeGrowSettings &settings, RNG::Fast &rng, GrowScratch &scratch) {
+	const int stride = w + 2;
+	uint8_t *grid;
+	{
+		scratch.grid.assign((size_t)stride * (h + 2), 0);
+		grid = scratch.grid.data();
+		for(int x = 0; x < stride; x++) {
+			grid[x] = CARVED;
+			grid[(size_t)(h + 1) * stride + x] = CARVED;
+		}
+		for(int y = 1; y <= h; y++) {
+			grid[(size_t)y * stride] = CARVED;
+			grid[(size_t)y * stride + w + 1] = CARVED;
+		}
 	}
-	if(direction == west) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings | Directions::West;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings | Directions::East;
+	const int offsets[9] = { 0, -stride, stride, 0, -1, 0, 0, 0, 1 };
+
+	scratch.cells.clear();
+	uint32_t start = (uint32_t)((1 + rng.next_below(h)) * stride + 1 + rng.next_below(w));
+	grid[start] |= CARVED;
+	scratch.cells.push_back(start);
+
+	while(!scratch.cells.empty()) {
+		size_t size = scratch.cells.size();
+		size_t index;
+		if(settings.selection == MazeSelection::Newest) {
+			index = size - 1;
+		} else if(settings.selection == MazeSelection::Random) {
+			index = rng.next_below((uint32_t)size);
+		} else {
+			index = (int)rng.next_below(100) < settings.newest_percent ? size - 1 : rng.next_below((uint32_t)size);
+		}
+
+		const uint32_t i = scratch.cells[index];
+
+		// uncarved neighbours as a direction mask, one of them is picked without shuffling
+		int candidates = ((grid[i - stride] & CARVED) ? 0 : North)
+			| ((grid[i + stride] & CARVED) ? 0 : South)
+			| ((grid[i - 1] & CARVED) ? 0 : West)
+			| ((grid[i + 1] & CARVED) ? 0 : East);
+
+		if(candidates == None) {
+			// swap remove, order only matters for newest which always takes the back
+			scratch.cells[index] = scratch.cells[size - 1];
+			scratch.cells.pop_back();
+			continue;
+		}
+
+		const int direction = nth_opening[candidates][rng.next_below(opening_count[candidates])];
+		const uint32_t neighbour = i + offsets[direction];
+
+		grid[i] |= (uint8_t)direction;
+		grid[neighbour] |= (uint8_t)(CARVED | opposite[direction]);
+		scratch.cells.push_back(neighbour);
 	}
-	if(direction == east) {
-		maze->buffer[maze->index(x, y)].Openings = maze->buffer[maze->index(x, y)].Openings | Directions::East;
-		maze->buffer[maze->index(x2, y2)].Openings = maze->buffer[maze->index(x2, y2)].Openings | Directions::West;
+
+	// regions don't overlap and the maze starts closed so the nibbles can just be or'ed in
+	for(int y = 0; y < h; y++) {
+		const uint8_t *row = grid + (size_t)(y + 1) * stride + 1;
+		size_t i = maze->index(x0, y0 + y);
+		for(int x = 0; x < w; x++, i++) {
+			maze->buffer[i >> 1] |= (uint8_t)((row[x] & 0xF) << ((i & 1) << 2));
+		}
 	}
 }
 
 void maze_grow_tree(Maze* maze) {
-	Rectangle bounds(0,0, maze->cols, maze->rows);
-	std::vector<Point> cellsToVisit;
+	MazeGrowSettings settings;
+	settings.seed = RNG::RNG_generator();
+	maze_grow_tree(maze, settings);
+}
 
-	Point p;
-	RNG::random_point_i(maze->cols, maze->rows, p.x, p.y);
-	cellsToVisit.push_back(p);
-	maze->buffer[maze->index(p.x, p.y)].IsOpen = true;
-	
-	while(!cellsToVisit.empty()) {
-		// How we select the next cell determines the properties of the maze
-		// Selection is important !!
-		int index = RNG::range_i(0, cellsToVisit.size() - 1);
-		
-		std::shuffle(std::begin(pointDirections), std::end(pointDirections), RNG::RNG_generator);
-		
-		for(auto &direction : pointDirections) {
-			Point neighbour = cellsToVisit[index] + direction;
-			if (bounds.contains(neighbour) && !maze->cell(neighbour).IsOpen) {
-				ASSERT_WITH_MSG(neighbour.x >= 0 && neighbour.y >= 0, "maze generation fucked up");
-				
-				maze->cell(neighbour).IsOpen = true;
-				Point &current = cellsToVisit[index];
-				
-				if (direction == north) {
-					maze->cell(current).IsTopWallOpen = true;
-					maze->cell(current).Openings |= Directions::North;
-					maze->cell(neighbour).Openings |= Directions::South;
-				} else if (direction == south) {
-			 		maze->cell(neighbour).IsTopWallOpen = true;
-			 		maze->cell(current).Openings |= Directions::South;
-			 		maze->cell(neighbour).Openings |= Directions::North;
-				} else if (direction == west) {
-					if(current.x == 0) {
-						Engine::log("hmmm, y: %d", current.y);
-					}
-					maze->cell(current).IsLeftWallOpen = true;
-					maze->cell(current).Openings |= Directions::West;
-					maze->cell(neighbour).Openings |= Directions::East;
-				} else if (direction == east) {
-					if(neighbour.x == 0) {
-						Engine::log("hoho, y: %d", neighbour.y);
-					}
-			 		maze->cell(neighbour).IsLeftWallOpen = true;
-			 		maze->cell(current).Openings |= Directions::East;
-			 		maze->cell(neighbour).Openings |= Directions::West;
-				}
-
-				cellsToVisit.push_back(neighbour);
-				index = -1;
-				break;
+void maze_grow_tree(Maze* maze, const MazeGrowSettings &settings) {
+	memset(maze->buffer, 0, maze_openings_size(maze->cols, maze->rows));
+	GrowScratch scratch;
+
+	if(settings.chunk_size <= 0 || (settings.chunk_size >= maze->cols && settings.chunk_size >= maze->rows)) {
+		RNG::Fast rng(settings.seed);
+		grow_tree_region(maze, 0, 0, maze->cols, maze->rows, settings, rng, scratch);
+		maze_notify(maze, MazeChange::All);
+		return;
+	}
+
+	const int size = settings.chunk_size;
+	const int chunks_x = (maze->cols + size - 1) / size;
+	const int chunks_y = (maze->rows + size - 1) / size;
+	for(int cy = 0; cy < chunks_y; cy++) {
+		for(int cx = 0; cx < chunks_x; cx++) {
+			RNG::Fast rng(region_seed(settings.seed, cx, cy));
+			const int x0 = cx * size;
+			const int y0 = cy * size;
+			grow_tree_region(maze, x0, y0, std::min(size, maze->cols - x0), std::min(size, maze->rows - y0), settings, rng, scratch);
+		}
+	}
+
+	// a tree over the chunks says which neighbouring chunks to join, one opening
+	// per join keeps the whole maze a tree
+	Maze chunk_tree;
+	maze_generate(chunk_tree, chunks_x, chunks_y);
+	MazeGrowSettings chunk_settings;
+	chunk_settings.selection = MazeSelection::Random;
+	RNG::Fast rng(region_seed(settings.seed, -1, -1));
+	grow_tree_region(&chunk_tree, 0, 0, chunks_x, chunks_y, chunk_settings, rng, scratch);
+
+	for(int cy = 0; cy < chunks_y; cy++) {
+		for(int cx = 0; cx < chunks_x; cx++) {
+			const int x0 = cx * size;
+			const int y0 = cy * size;
+			if(chunk_tree.is_open(cx, cy, East)) {
+				const int h = std::min(size, maze->rows - y0);
+				open_towards(maze, x0 + size - 1, y0 + (int)rng.next_below(h), East);
+			}
+			if(chunk_tree.is_open(cx, cy, South)) {
+				const int w = std::min(size, maze->cols - x0);
+				open_towards(maze, x0 + (int)rng.next_below(w), y0 + size - 1, South);
 			}
 		}
-		
-		if (index >= 0) 
-			cellsToVisit.erase(cellsToVisit.begin() + index); // cellsToVisit.RemoveAt(index);
 	}
+	maze_free(&chunk_tree);
+	maze_notify(maze, MazeChange::All);
 }
 
 int maze_num_connections(const Maze *maze, const int x, const int y) {
-	int count = 0;
-	for(auto &dir : pointDirections) {
-		// maze_connection_is_open(Maze *maze, int x, int y, int x2, int y2)
-		if(maze_connection_is_open(maze, x, y, x + dir.x, y + dir.y))
-			count++;
-	}
-	return count;
+	return opening_count[maze->openings(x, y)];
 }
 
 void maze_close_all_connection(Maze *maze, const int x, const int y) {
@@ -277,37 +372,342 @@ void maze_close_and_scramble_room(Maze *maze, const int x, const int y, const in
 }
 
 void maze_free(Maze* maze) {
-	delete[] maze->buffer;
+	delete[] (uint64_t*)maze->data;
+	maze->data = nullptr;
+	maze->buffer = nullptr;
+	maze->visited = nullptr;
+	maze->completed = nullptr;
+}
+
+static const uint32_t MAZE_MAGIC = 0x315A4D53; // "SMZ1"
+
+struct MazeHeader {
+	uint32_t magic;
+	int32_t cols;
+	int32_t rows;
+};
+
+void maze_serialize(std::ostream &stream, const Maze &maze) {
+	MazeHeader header = { MAZE_MAGIC, maze.cols, maze.rows };
+	stream.write(reinterpret_cast<const char *>(&header), sizeof(MazeHeader));
+	stream.write(reinterpret_cast<const char *>(maze.data), maze_data_size(maze.cols, maze.rows));
+}
+
+bool maze_deserialize(std::istream &stream, Maze &maze) {
+	MazeHeader header;
+	if(!stream.read(reinterpret_cast<char *>(&header), sizeof(MazeHeader)) || header.magic != MAZE_MAGIC || header.cols <= 0 || header.rows <= 0) {
+		return false;
+	}
+
+	Maze loaded;
+	maze_allocate(loaded, header.cols, header.rows);
+	if(!stream.read(reinterpret_cast<char *>(loaded.data), maze_data_size(loaded.cols, loaded.rows))) {
+		maze_free(&loaded);
+		return false;
+	}
+	
+	// keep on_change
+	maze_free(&maze);
+	maze.cols = loaded.cols;
+	maze.rows = loaded.rows;
+	maze.data = loaded.data;
+	maze.buffer = loaded.buffer;
+	maze.visited = loaded.visited;
+	maze.completed = loaded.completed;
+	maze_notify(&maze, MazeChange::All);
+	return true;
+}
+
+// Neighbour index offsets by direction, same layout as opposite
+static void neighbour_offsets(const Maze *maze, int offsets[9]) {
+	for(int i = 0; i < 9; i++) {
+		offsets[i] = 0;
+	}
+	offsets[North] = -maze->cols;
+	offsets[South] = maze->cols;
+	offsets[West] = -1;
+	offsets[East] = 1;
+}
+
+static const Directions all_directions[4] = { North, South, West, East };
+
+static Directions openings_at(const Maze *maze, uint32_t i) {
+	return (Directions)((maze->buffer[i >> 1] >> ((i & 1) << 2)) & 0xF);
+}
+
+static void search_prepare(const Maze *maze, MazeSearch &search) {
+	const size_t count = (size_t)maze->cols * maze->rows;
+	if(search.seen.size() < count) {
+		search.parent.resize(count);
+		search.cost.resize(count);
+		search.seen.assign(count, 0);
+		search.stamp = 0;
+		search.queue.reserve(count);
+		search.open.reserve(count);
+	}
+	// stamps mark the cells seen by this search so nothing has to be cleared
+	search.stamp++;
+	if(search.stamp == 0) {
+		std::fill(search.seen.begin(), search.seen.end(), 0);
+		search.stamp = 1;
+	}
+	search.queue.clear();
+	search.open.clear();
+}
+
+static void search_path(const Maze *maze, const MazeSearch &search, uint32_t start, uint32_t target, std::vector<Point> &path) {
+	path.clear();
+	for(uint32_t i = target; ; i = search.parent[i]) {
+		path.push_back(Point((int)(i % maze->cols), (int)(i / maze->cols)));
+		if(i == start) {
+			break;
+		}
+	}
+	std::reverse(path.begin(), path.end());
+}
+
+bool maze_path_bfs(const Maze *maze, MazeSearch &search, const Point &start, const Point &target, std::vector<Point> &path) {
+	path.clear();
+	if(!maze->contains(start.x, start.y) || !maze->contains(target.x, target.y)) {
+		return false;
+	}
+	search_prepare(maze, search);
+	int offsets[9];
+	neighbour_offsets(maze, offsets);
+
+	const uint32_t start_index = (uint32_t)maze->index(start.x, start.y);
+	const uint32_t target_index = (uint32_t)maze->index(target.x, target.y);
+	search.seen[start_index] = search.stamp;
+	search.parent[start_index] = start_index;
+	search.queue.push_back(start_index);
+	for(size_t q = 0; q < search.queue.size(); q++) {
+		const uint32_t i = search.queue[q];
+		if(i == target_index) {
+			search_path(maze, search, start_index, target_index, path);
+			return true;
+		}
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && search.seen[n] != search.stamp) {
+				search.seen[n] = search.stamp;
+				search.parent[n] = i;
+				search.queue.push_back(n);
+			}
+		}
+	}
+	return false;
+}
+
+bool maze_path_astar(const Maze *maze, MazeSearch &search, const Point &start, const Point &target, std::vector<Point> &path) {
+	path.clear();
+	if(!maze->contains(start.x, start.y) || !maze->contains(target.x, target.y)) {
+		return false;
+	}
+	search_prepare(maze, search);
+	int offsets[9];
+	neighbour_offsets(maze, offsets);
+
+	const uint32_t start_index = (uint32_t)maze->index(start.x, start.y);
+	const uint32_t target_index = (uint32_t)maze->index(target.x, target.y);
+	auto heuristic = [&](uint32_t i) {
+		return (uint32_t)(std::abs((int)(i % maze->cols) - target.x) + std::abs((int)(i / maze->cols) - target.y));
+	};
+	// min heap on estimated cost, the cell index in the low bits
+	auto push = [&](uint32_t i) {
+		search.open.push_back(((uint64_t)(search.cost[i] + heuristic(i)) << 32) | i);
+		std::push_heap(search.open.begin(), search.open.end(), std::greater<uint64_t>());
+	};
+
+	search.seen[start_index] = search.stamp;
+	search.parent[start_index] = start_index;
+	search.cost[start_index] = 0;
+	push(start_index);
+	while(!search.open.empty()) {
+		std::pop_heap(search.open.begin(), search.open.end(), std::greater<uint64_t>());
+		const uint64_t entry = search.open.back();
+		search.open.pop_back();
+		const uint32_t i = (uint32_t)entry;
+		if((uint32_t)(entry >> 32) != search.cost[i] + heuristic(i)) {
+			continue; // a cheaper way here was found after this was pushed
+		}
+		if(i == target_index) {
+			search_path(maze, search, start_index, target_index, path);
+			return true;
+		}
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if(!(openings & d)) {
+				continue;
+			}
+			const uint32_t cost = search.cost[i] + 1;
+			if(search.seen[n] != search.stamp || cost < search.cost[n]) {
+				search.seen[n] = search.stamp;
+				search.parent[n] = i;
+				search.cost[n] = cost;
+				push(n);
+			}
+		}
+	}
+	return false;
+}
+
+// Lowers distances outwards from the cells already in field.queue
+static void distance_field_spread(const Maze *maze, MazeDistanceField &field, size_t from) {
+	int offsets[9];
+	neighbour_offsets(maze, offsets);
+	for(size_t q = from; q < field.queue.size(); q++) {
+		const uint32_t i = field.queue[q];
+		const uint32_t next = field.distance[i] + 1;
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && field.distance[n] > next) {
+				field.distance[n] = next;
+				field.queue.push_back(n);
+			}
+		}
+	}
+	field.queue.clear();
 }
 
-void maze_serialize(std::ostream &stream, Maze &maze) {
-	stream.write(reinterpret_cast<char *>(&maze.cols), sizeof(int));
-	stream.write(reinterpret_cast<char *>(&maze.rows), sizeof(int));
-	int cellCount = maze.cols * maze.rows;
-	for(int i = 0; i < cellCount; i++) {
-		stream.write(reinterpret_cast<char *>(&maze.buffer[i]), sizeof(Cell));
-		//cell_serialize(stream, maze.buffer[i]);
+void maze_distance_field_build(const Maze *maze, MazeDistanceField &field, const Point &origin) {
+	const size_t count = (size_t)maze->cols * maze->rows;
+	field.origin = origin;
+	field.cols = maze->cols;
+	field.distance.assign(count, MAZE_UNREACHABLE);
+	field.affected.assign(count, 0);
+	field.queue.reserve(count);
+	field.queue.clear();
+	field.seeds.clear();
+	if(!maze->contains(origin.x, origin.y)) {
+		return;
 	}
+
+	const uint32_t o = (uint32_t)maze->index(origin.x, origin.y);
+	field.distance[o] = 0;
+	field.queue.push_back(o);
+	distance_field_spread(maze, field, 0);
 }
 
-void maze_deserialize(std::istream &stream, Maze &maze) {
-	stream.read(reinterpret_cast<char *>(&maze.cols), sizeof(int));
-	stream.read(reinterpret_cast<char *>(&maze.rows), sizeof(int));
-	int cellCount = maze.cols * maze.rows;
-	if(maze.buffer != nullptr)
-		delete [] maze.buffer;
+void maze_distance_field_update(const Maze *maze, MazeDistanceField &field, const MazeChange &change) {
+	if(change.type == MazeChange::All || field.cols != maze->cols || field.distance.size() != (size_t)maze->cols * maze->rows) {
+		maze_distance_field_build(maze, field, field.origin);
+		return;
+	}
+
+	const uint32_t a = (uint32_t)maze->index(change.a.x, change.a.y);
+	const uint32_t b = (uint32_t)maze->index(change.b.x, change.b.y);
+	const uint32_t da = field.distance[a];
+	const uint32_t db = field.distance[b];
+
+	if(change.type == MazeChange::Opened) {
+		// only ever shortens, spread from whichever side got closer
+		const uint32_t near_cell = da < db ? a : b;
+		const uint32_t far_cell = da < db ? b : a;
+		const uint32_t near_distance = field.distance[near_cell];
+		if(near_distance != MAZE_UNREACHABLE && field.distance[far_cell] > near_distance + 1) {
+			field.distance[far_cell] = near_distance + 1;
+			field.queue.push_back(far_cell);
+			distance_field_spread(maze, field, 0);
+		}
+		return;
+	}
+
+	// Closed, only matters if the far side used it as its way back to the origin
+	if(da == db || (da == MAZE_UNREACHABLE && db == MAZE_UNREACHABLE)) {
+		return;
+	}
+	const uint32_t far_cell = da > db ? a : b;
+	const uint32_t far_distance = field.distance[far_cell];
+	if(far_distance != (da > db ? db : da) + 1) {
+		return;
+	}
+
+	int offsets[9];
+	neighbour_offsets(maze, offsets);
+	auto has_parent = [&](uint32_t i) {
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && !field.affected[n] && field.distance[n] + 1 == field.distance[i]) {
+				return true;
+			}
+		}
+		return false;
+	};
+	if(has_parent(far_cell)) {
+		return;
+	}
+
+	// cells whose every shortest way back went through the closed connection,
+	// in order of distance so all parents of a cell are decided before it
+	std::vector<uint32_t> &affected = field.queue;
+	affected.push_back(far_cell);
+	field.affected[far_cell] = 1;
+	for(size_t q = 0; q < affected.size(); q++) {
+		const uint32_t i = affected[q];
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && !field.affected[n] && field.distance[n] == field.distance[i] + 1 && !has_parent(n)) {
+				field.affected[n] = 1;
+				affected.push_back(n);
+			}
+		}
+	}
+
+	// best distance for each affected cell from its unaffected neighbours
+	field.seeds.clear();
+	for(auto i : affected) {
+		uint32_t best = MAZE_UNREACHABLE;
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && !field.affected[n] && field.distance[n] != MAZE_UNREACHABLE && field.distance[n] + 1 < best) {
+				best = field.distance[n] + 1;
+			}
+		}
+		field.distance[i] = best;
+		if(best != MAZE_UNREACHABLE) {
+			field.seeds.push_back(((uint64_t)best << 32) | i);
+		}
+	}
+	std::sort(field.seeds.begin(), field.seeds.end());
 
-	maze.buffer = new Cell[cellCount];
-	for(int i = 0; i < cellCount; i++) {
-		stream.read(reinterpret_cast<char *>(&maze.buffer[i]), sizeof(Cell));
-		//cell_deserialize(stream, maze.buffer[i]);
+	// breadth first from the seeds in distance order, merging the sorted seeds
+	// with the queue keeps cells coming out shortest first
+	for(auto i : affected) {
+		field.affected[i] = 0;
+	}
+	field.queue.clear();
+	size_t seed = 0;
+	size_t q = 0;
+	while(seed < field.seeds.size() || q < field.queue.size()) {
+		uint32_t i;
+		if(q >= field.queue.size() || (seed < field.seeds.size() && (uint32_t)(field.seeds[seed] >> 32) <= field.distance[field.queue[q]])) {
+			i = (uint32_t)field.seeds[seed++];
+		} else {
+			i = field.queue[q++];
+		}
+		const uint32_t next = field.distance[i] + 1;
+		const Directions openings = openings_at(maze, i);
+		for(auto d : all_directions) {
+			const uint32_t n = i + offsets[d];
+			if((openings & d) && field.distance[n] > next) {
+				field.distance[n] = next;
+				field.queue.push_back(n);
+			}
+		}
 	}
+	field.queue.clear();
 }
 
 void maze_log(Maze* maze, std::ostringstream &ss) {
 	for (int y = 0; y < maze->rows; y++) {
 		for (int x = 0; x < maze->cols; x++) {
-			if((maze->buffer[maze->index(x, y)].Openings & Directions::North) == Directions::North) {
+			if(maze->is_open(x, y, Directions::North)) {
 				 ss << " |";
 			 } else {
 				 ss << "  ";
@@ -315,7 +715,7 @@ void maze_log(Maze* maze, std::ostringstream &ss) {
 		}
 		ss << "\n";
  		for (int x = 0; x < maze->cols; x++) {
-			 if((maze->buffer[maze->index(x, y)].Openings & Directions::West) == Directions::West) {
+			 if(maze->is_open(x, y, Directions::West)) {
 				 ss << "-O";
 			 } else {
 				 ss << " O";
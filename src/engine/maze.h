@@ -24,24 +24,69 @@ inline Directions operator&=(Directions& a, Directions b) {
     return a = a & b;
 }
 
-struct Cell {
-	bool IsOpen = false;
-	bool IsLeftWallOpen = false;
-	bool IsTopWallOpen = false;
-	Directions Openings = Directions::None;
+struct Maze;
+
+// Passed to Maze::on_change. All is used for changes to the whole maze
+// (maze_close_all, maze_open_all, maze_grow_tree, maze_deserialize).
+struct MazeChange {
+	enum Type { Opened, Closed, All } type;
+	Point a;
+	Point b;
 };
 
+// Openings are 4 bits (Directions) per cell, two cells per byte, low nibble first.
+// Visited and completed are one bit per cell. All three live in one allocation
+// (data) so the maze can be saved and loaded with a single read or write.
 struct Maze {
-	int cols;
-	int rows;
-	Cell* buffer = nullptr;
+	int cols = 0;
+	int rows = 0;
+	uint8_t *data = nullptr;
+	uint8_t *buffer = nullptr;
+	uint64_t *visited = nullptr;
+	uint64_t *completed = nullptr;
+	// called after connections change, used to keep distance fields up to date
+	std::function<void(Maze &maze, const MazeChange &change)> on_change;
+
 	size_t index(int x, int y) const { return x + cols * y; }
-	Cell &cell(Point &p) { return buffer[index(p.x, p.y)]; };
-	Cell &cell(int x, int y) { return buffer[index(x, y)]; };
+	bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < cols && y < rows; }
+
+	Directions openings(int x, int y) const {
+		size_t i = index(x, y);
+		return (Directions)((buffer[i >> 1] >> ((i & 1) << 2)) & 0xF);
+	}
+	Directions openings(const Point &p) const { return openings(p.x, p.y); }
+	void set_openings(int x, int y, Directions d) {
+		size_t i = index(x, y);
+		int shift = (int)(i & 1) << 2;
+		buffer[i >> 1] = (uint8_t)((buffer[i >> 1] & ~(0xF << shift)) | (((int)d & 0xF) << shift));
+	}
+	bool is_open(int x, int y, Directions d) const { return (openings(x, y) & d) == d; }
+
+	bool is_visited(int x, int y) const { size_t i = index(x, y); return (visited[i >> 6] >> (i & 63)) & 1; }
+	void set_visited(int x, int y) { size_t i = index(x, y); visited[i >> 6] |= 1ull << (i & 63); }
+	bool is_completed(int x, int y) const { size_t i = index(x, y); return (completed[i >> 6] >> (i & 63)) & 1; }
+	void set_completed(int x, int y) { size_t i = index(x, y); completed[i >> 6] |= 1ull << (i & 63); }
+};
+
+// Which cell the growing tree continues from, newest makes long corridors,
+// random makes short dead ends, mixed picks newest newest_percent of the time
+enum class MazeSelection { Newest, Random, Mixed };
+
+struct MazeGrowSettings {
+	uint32_t seed = 1;
+	MazeSelection selection = MazeSelection::Random;
+	int newest_percent = 50;
+	// 0 grows the whole maze as one tree, otherwise chunk_size x chunk_size regions
+	// are grown on their own and joined by one opening per neighbouring region.
+	// Much faster on big mazes since each region fits in cache.
+	int chunk_size = 0;
 };
 
 void maze_generate(Maze &maze, int cols, int rows);
+// Random selection with a seed from RNG::RNG_generator
 void maze_grow_tree(Maze* maze);
+// Same seed and settings always give the same maze
+void maze_grow_tree(Maze* maze, const MazeGrowSettings &settings);
 int maze_num_connections(const Maze *maze, const int x, const int y);
 bool maze_connection_is_open(const Maze *maze, const Point start, const Point target);
 bool maze_connection_is_open(const Maze *maze, const int x, const int y, const int x2, const int y2);
@@ -55,10 +100,50 @@ void maze_close_all_connection(Maze *maze, const int x, const int y);
 void maze_rotate_room(Maze *maze, int x, int y, bool rotate_clockwise = false);
 void maze_close_and_scramble_room(Maze *maze, const int x, const int y, const int x_from, const int y_from);
 void maze_free(Maze* maze);
-void maze_serialize(std::ostream &stream, Maze &maze);
-void maze_deserialize(std::istream &stream, Maze &maze);
+// Bytes used by openings, visited and completed together
+size_t maze_data_size(int cols, int rows);
+void maze_serialize(std::ostream &stream, const Maze &maze);
+// false if the stream does not hold a maze, maze is left untouched then
+bool maze_deserialize(std::istream &stream, Maze &maze);
 void maze_log(Maze* maze, std::ostringstream &ss);
 
+const uint32_t MAZE_UNREACHABLE = 0xFFFFFFFF;
+
+// Scratch memory for path searches. Grows to the maze size on first use and keeps
+// its capacity, so searches after that don't allocate. Pass the same path vector
+// each time for the same reason.
+struct MazeSearch {
+	std::vector<uint32_t> parent;
+	std::vector<uint32_t> cost;
+	std::vector<uint32_t> seen;
+	uint32_t stamp = 0;
+	std::vector<uint32_t> queue;
+	std::vector<uint64_t> open;
+};
+
+// Fills path with the cells from start to target, both included, false if target can't be reached
+bool maze_path_bfs(const Maze *maze, MazeSearch &search, const Point &start, const Point &target, std::vector<Point> &path);
+bool maze_path_astar(const Maze *maze, MazeSearch &search, const Point &start, const Point &target, std::vector<Point> &path);
+
+// Steps from origin to every cell, MAZE_UNREACHABLE for cells that are cut off
+struct MazeDistanceField {
+	Point origin;
+	int cols = 0;
+	std::vector<uint32_t> distance;
+
+	// scratch for updates
+	std::vector<uint32_t> queue;
+	std::vector<uint64_t> seeds;
+	std::vector<uint8_t> affected;
+
+	uint32_t at(int x, int y) const { return distance[x + cols * y]; }
+	uint32_t at(const Point &p) const { return at(p.x, p.y); }
+};
+
+void maze_distance_field_build(const Maze *maze, MazeDistanceField &field, const Point &origin);
+// Only visits the cells whose distance changes
+void maze_distance_field_update(const Maze *maze, MazeDistanceField &field, const MazeChange &change);
+
 //void connectRooms(Maze *maze, int x, int y, int x2, int y2);
 //int getNumExits(Maze* maze);
 //void printMaze(Maze* maze);
@@ -65,7 +65,7 @@ namespace Particles {
 	}
 
     void render_circles(const ParticleContainer &c) {
-		const auto &camera = get_camera();
+		const Vector2 camera = camera_render_position();
 		const Particle *particles = c.particles;
         for(int i = 0; i < c.length; i++) {
             draw_g_circle_RGBA((int)(particles[i].position.x - camera.x), 
@@ -79,7 +79,7 @@ namespace Particles {
     }
 
 	void render_circles_filled(const ParticleContainer &c) {
-		const auto &camera = get_camera();
+		const Vector2 camera = camera_render_position();
 		const Particle *particles = c.particles;
         for(int i = 0; i < c.length; i++) {
             draw_g_circle_filled_RGBA((int)(particles[i].position.x - camera.x), 
@@ -93,7 +93,7 @@ namespace Particles {
     }
 
 	void render_rectangles_filled(const ParticleContainer &c) {
-		const auto &camera = get_camera();
+		const Vector2 camera = camera_render_position();
 		const Particle *particles = c.particles;
 		for(int i = 0; i < c.length; i++) {
 			draw_g_rectangle_filled_RGBA((int)(particles[i].position.x - camera.x), 
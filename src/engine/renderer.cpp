@@ -1,6 +1,9 @@
 #include "renderer.h"
 #include "SDL_image.h"
 #include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 unsigned gw;
 unsigned gh;
@@ -13,6 +16,264 @@ Font *default_font;
 gfx renderer;
 Camera camera;
 
+// Every draw goes through submit as a RenderCommand. Normally it is executed
+// right away, in pipelined mode it is recorded into a frame on the simulation
+// thread and replayed on the main thread by renderer_pipeline_present.
+struct RenderCommand {
+	// CopyToWindow centers the texture in the window at replay, dest.x/y is an offset
+	enum Type : uint8_t { Copy, CopyToWindow, TextureMod, FillRects, DrawPoints, DrawLines, Clear, Target };
+	Type type;
+	SDL_Color color;
+	SDL_Texture *texture;
+	SDL_Rect src;
+	SDL_Rect dest;
+	SDL_Point center;
+	bool has_src;
+	bool has_center;
+	SDL_RendererFlip flip;
+	float angle;
+	// range in the frame's rects or points
+	int offset;
+	int count;
+};
+
+namespace Pipeline {
+	struct Frame {
+		std::vector<RenderCommand> commands;
+		std::vector<SDL_Rect> rects;
+		std::vector<SDL_Point> points;
+		uint64_t timestamp = 0;
+
+		void clear() {
+			commands.clear();
+			rects.clear();
+			points.clear();
+		}
+	};
+
+	// one being recorded, one finished and one being replayed
+	static Frame frames[3];
+	static int write_index = 0;
+	static int ready_index = 1;
+	static int read_index = 2;
+	static bool ready_fresh = false;
+	static bool stopped = false;
+	static bool recording = false;
+	static std::mutex mutex;
+	static std::condition_variable frame_changed;
+}
+
+static void execute(const RenderCommand &c, const SDL_Rect *rects, const SDL_Point *points) {
+	switch(c.type) {
+		case RenderCommand::Copy:
+			if(c.angle == 0.0f && c.flip == SDL_FLIP_NONE) {
+				SDL_RenderCopy(renderer.renderer, c.texture, c.has_src ? &c.src : NULL, &c.dest);
+			} else {
+				SDL_RenderCopyEx(renderer.renderer, c.texture, c.has_src ? &c.src : NULL, &c.dest, c.angle, c.has_center ? &c.center : NULL, c.flip);
+			}
+			break;
+		case RenderCommand::CopyToWindow: {
+			// the window size belongs to the thread that replays, recording never reads it
+			SDL_Rect dest;
+			dest.w = gw * step_scale;
+			dest.h = gh * step_scale;
+			dest.x = (window_w / 2) - (dest.w / 2) + c.dest.x;
+			dest.y = (window_h / 2) - (dest.h / 2) + c.dest.y;
+			SDL_RenderCopy(renderer.renderer, c.texture, NULL, &dest);
+			break;
+		}
+		case RenderCommand::TextureMod:
+			SDL_SetTextureColorMod(c.texture, c.color.r, c.color.g, c.color.b);
+			SDL_SetTextureAlphaMod(c.texture, c.color.a);
+			break;
+		case RenderCommand::FillRects:
+		case RenderCommand::DrawPoints:
+		case RenderCommand::DrawLines:
+			SDL_SetRenderDrawBlendMode(renderer.renderer, (c.color.a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
+			SDL_SetRenderDrawColor(renderer.renderer, c.color.r, c.color.g, c.color.b, c.color.a);
+			if(c.type == RenderCommand::FillRects) {
+				SDL_RenderFillRects(renderer.renderer, rects + c.offset, c.count);
+			} else if(c.type == RenderCommand::DrawPoints) {
+				SDL_RenderDrawPoints(renderer.renderer, points + c.offset, c.count);
+			} else {
+				// no batched call for separate segments in this SDL version
+				for(int i = c.offset; i + 1 < c.offset + c.count; i += 2) {
+					SDL_RenderDrawLine(renderer.renderer, points[i].x, points[i].y, points[i + 1].x, points[i + 1].y);
+				}
+			}
+			break;
+		case RenderCommand::Clear:
+			SDL_SetRenderDrawColor(renderer.renderer, c.color.r, c.color.g, c.color.b, c.color.a);
+			SDL_RenderClear(renderer.renderer);
+			break;
+		case RenderCommand::Target:
+			SDL_SetRenderTarget(renderer.renderer, c.texture);
+			break;
+	}
+}
+
+// commands submitted since the last flip, about one SDL call each
+static uint32_t frame_draw_calls = 0;
+
+static void submit(RenderCommand &c, const SDL_Rect *rects = NULL, const SDL_Point *points = NULL) {
+	frame_draw_calls++;
+	if(!Pipeline::recording) {
+		c.offset = 0;
+		execute(c, rects, points);
+		return;
+	}
+
+	Pipeline::Frame &frame = Pipeline::frames[Pipeline::write_index];
+	if(rects != NULL) {
+		c.offset = (int)frame.rects.size();
+		frame.rects.insert(frame.rects.end(), rects, rects + c.count);
+	} else if(points != NULL) {
+		c.offset = (int)frame.points.size();
+		frame.points.insert(frame.points.end(), points, points + c.count);
+	}
+	frame.commands.push_back(c);
+}
+
+static inline RenderCommand command(RenderCommand::Type type) {
+	RenderCommand c;
+	c.type = type;
+	c.texture = NULL;
+	c.has_src = false;
+	c.has_center = false;
+	c.flip = SDL_FLIP_NONE;
+	c.angle = 0.0f;
+	c.offset = 0;
+	c.count = 0;
+	return c;
+}
+
+static void submit_copy(SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect &dest, float angle = 0.0f, const SDL_Point *center = NULL, SDL_RendererFlip flip = SDL_FLIP_NONE) {
+	RenderCommand c = command(RenderCommand::Copy);
+	c.texture = texture;
+	if(src != NULL) {
+		c.src = *src;
+		c.has_src = true;
+	}
+	if(center != NULL) {
+		c.center = *center;
+		c.has_center = true;
+	}
+	c.dest = dest;
+	c.angle = angle;
+	c.flip = flip;
+	submit(c);
+}
+
+static void submit_copy_to_window(SDL_Texture *texture, int offset_x, int offset_y) {
+	RenderCommand c = command(RenderCommand::CopyToWindow);
+	c.texture = texture;
+	c.dest.x = offset_x;
+	c.dest.y = offset_y;
+	submit(c);
+}
+
+static void submit_texture_mod(SDL_Texture *texture, const SDL_Color &color) {
+	RenderCommand c = command(RenderCommand::TextureMod);
+	c.texture = texture;
+	c.color = color;
+	submit(c);
+}
+
+static void submit_clear(const SDL_Color &color) {
+	RenderCommand c = command(RenderCommand::Clear);
+	c.color = color;
+	submit(c);
+}
+
+// last target submitted, what will be active when the commands run (SDL can't be asked while recording)
+static SDL_Texture *submitted_target = NULL;
+
+static void submit_target(SDL_Texture *target) {
+	submitted_target = target;
+	RenderCommand c = command(RenderCommand::Target);
+	c.texture = target;
+	submit(c);
+}
+
+// draw_g_* calls are queued and drawn with as few SDL calls as possible.
+// Horizontal and vertical lines, rectangles and filled circles become filled rects,
+// circle and ellipse outlines become point lists. The batch is flushed when the
+// kind or color changes and before anything else draws or changes render target.
+namespace PrimitiveBatch {
+	enum Kind { None, Points, Lines, Rects };
+
+	static Kind kind = None;
+	static SDL_Color color = { 0, 0, 0, 255 };
+	static std::vector<SDL_Point> points;
+	static std::vector<SDL_Rect> rects;
+
+	static void flush() {
+		if(kind == None) {
+			return;
+		}
+
+		if(kind == Rects) {
+			RenderCommand c = command(RenderCommand::FillRects);
+			c.color = color;
+			c.count = (int)rects.size();
+			submit(c, rects.data(), NULL);
+		} else {
+			RenderCommand c = command(kind == Points ? RenderCommand::DrawPoints : RenderCommand::DrawLines);
+			c.color = color;
+			c.count = (int)points.size();
+			submit(c, NULL, points.data());
+		}
+		points.clear();
+		rects.clear();
+		kind = None;
+	}
+
+	static inline void set_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+		if(color.r != r || color.g != g || color.b != b || color.a != a) {
+			flush();
+			color = { r, g, b, a };
+		}
+	}
+
+	static inline void begin(Kind k) {
+		if(kind != k) {
+			flush();
+			kind = k;
+		}
+	}
+
+	static inline void point(int x, int y) {
+		begin(Points);
+		points.push_back({ x, y });
+	}
+
+	static inline void line(int x1, int y1, int x2, int y2) {
+		begin(Lines);
+		points.push_back({ x1, y1 });
+		points.push_back({ x2, y2 });
+	}
+
+	static inline void rect(int x, int y, int w, int h) {
+		if(w <= 0 || h <= 0) {
+			return;
+		}
+		begin(Rects);
+		rects.push_back({ x, y, w, h });
+	}
+
+	static inline void horizontal_line(int x1, int x2, int y) {
+		rect(x1 < x2 ? x1 : x2, y, (x1 < x2 ? x2 - x1 : x1 - x2) + 1, 1);
+	}
+
+	static inline void vertical_line(int x, int y1, int y2) {
+		rect(x, y1 < y2 ? y1 : y2, 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1);
+	}
+}
+
+namespace TextCache {
+	static GlyphAtlas *atlas_get(Font *font);
+}
+
 namespace Resources {
 	std::unordered_map<std::string, Sprite*> sprites;
 	std::unordered_map<std::string, Font*> fonts;
@@ -108,25 +369,140 @@ namespace Resources {
         pitch = 0;
     }
 
-    Sprite *sprite_load(const std::string &name, const std::string &filename) {
-		std::string path = Engine::get_base_data_folder() + filename;
-		Sprite *s = new Sprite;
-    	s->image = load_texture(path, s->w, s->h);
-		sprites[name] = s;
+	static ResourceCacheStats cache;
+	static uint64_t cache_clock = 0;
+	static const size_t DEFAULT_CACHE_BUDGET = 64 * 1024 * 1024;
+
+	static void sprite_unload(Sprite *s) {
+		if(s->image != NULL) {
+			SDL_DestroyTexture(s->image);
+			s->image = NULL;
+			cache.resident_bytes -= s->bytes;
+		}
+	}
+
+	static void sprite_reload(Sprite *s) {
+		std::string path = Engine::get_base_data_folder() + s->filename;
+		if(s->white) {
+			s->image = load_streaming_texture(path, s->w, s->h);
+			if(s->image != NULL) {
+				transform_non_transparent_to_white(s->image, s->h);
+			}
+		} else {
+			s->image = load_texture(path, s->w, s->h);
+		}
+		s->bytes = s->image != NULL ? (size_t)s->w * (size_t)s->h * 4 : 0;
+		cache.resident_bytes += s->bytes;
+	}
+
+	void cache_trim() {
+		if(cache.budget_bytes == 0) {
+			cache.budget_bytes = DEFAULT_CACHE_BUDGET;
+		}
+		// textures can't be reloaded from the simulation thread
+		if(Pipeline::recording) {
+			return;
+		}
+		while(cache.resident_bytes > cache.budget_bytes) {
+			Sprite *oldest = NULL;
+			for(auto &entry : sprites) {
+				Sprite *s = entry.second;
+				if(s->image == NULL || s->pinned || s->references > 0) {
+					continue;
+				}
+				if(oldest == NULL || s->last_used < oldest->last_used) {
+					oldest = s;
+				}
+			}
+			if(oldest == NULL) {
+				return;
+			}
+			sprite_unload(oldest);
+			cache.evictions++;
+		}
+	}
+
+	static Sprite *sprite_load_internal(const std::string &name, const std::string &filename, bool white) {
+		// scenes load their sprites on every enter, reuse the entry if nothing changed
+		Sprite *s;
+		auto itr = sprites.find(name);
+		if(itr != sprites.end()) {
+			s = itr->second;
+			if(s->filename == filename && s->white == white && s->image != NULL) {
+				s->last_used = ++cache_clock;
+				cache.hits++;
+				return s;
+			}
+			sprite_unload(s);
+		} else {
+			s = new Sprite;
+			sprites[name] = s;
+		}
+		s->filename = filename;
+		s->white = white;
+		sprite_reload(s);
+		s->last_used = ++cache_clock;
+		cache.misses++;
+		// held while trimming so it can't be evicted before it is returned
+		s->references++;
+		cache_trim();
+		s->references--;
 		return s;
 	}
 
+    Sprite *sprite_load(const std::string &name, const std::string &filename) {
+		return sprite_load_internal(name, filename, false);
+	}
+
 	Sprite *sprite_load_white(const std::string &name, const std::string &filename) {
-		std::string path = Engine::get_base_data_folder() + filename;
-		Sprite *s = new Sprite;
-    	s->image = load_streaming_texture(path, s->w, s->h);
-		transform_non_transparent_to_white(s->image, s->h);
-		sprites[name] = s;
-		return s;
+		return sprite_load_internal(name, filename, true);
 	}
 
     Sprite *sprite_get(const std::string &name) {
-		return sprites.at(name);
+		Sprite *s = sprites.at(name);
+		s->last_used = ++cache_clock;
+		if(s->image != NULL) {
+			cache.hits++;
+			return s;
+		}
+		cache.misses++;
+		sprite_reload(s);
+		// held while trimming so it can't be evicted before it is returned
+		s->references++;
+		cache_trim();
+		s->references--;
+		return s;
+	}
+
+	SpriteHandle sprite_acquire(const std::string &name) {
+		SpriteHandle handle;
+		handle.sprite = sprites.at(name);
+		handle.sprite->references++;
+		// reloads if it was evicted
+		sprite_get(name);
+		return handle;
+	}
+
+	void sprite_release(SpriteHandle &handle) {
+		if(handle.sprite != NULL) {
+			ASSERT_WITH_MSG(handle.sprite->references > 0, "sprite_release, handle released twice");
+			handle.sprite->references--;
+			handle.sprite = NULL;
+			cache_trim();
+		}
+	}
+
+	void cache_set_budget(size_t bytes) {
+		cache.budget_bytes = bytes;
+		cache_trim();
+	}
+
+	const ResourceCacheStats &cache_stats() {
+		return cache;
+	}
+
+	static void cache_track_pinned(int64_t bytes) {
+		cache.resident_bytes = (size_t)((int64_t)cache.resident_bytes + bytes);
 	}
 
 	SDL_Rect &sprite_get_from_sheet(const size_t &sprite_sheet_index, const std::string &name) {
@@ -138,7 +514,7 @@ namespace Resources {
     void sprite_remove(const std::string &name) {
 		auto itr = sprites.find(name);
 		if (itr != sprites.end()) {
-			SDL_DestroyTexture(itr->second->image);
+			sprite_unload(itr->second);
     		delete itr->second;
     		sprites.erase(itr);
 		}
@@ -151,7 +527,7 @@ namespace Resources {
 		
 		sprite_sheet_data >> s.sprite_sheet_name;
 
-		Resources::sprite_load(s.sprite_sheet_name, s.sprite_sheet_name);
+		Resources::sprite_load(s.sprite_sheet_name, s.sprite_sheet_name)->pinned = true;
 
 		if(sprite_sheet_data) {
 			int sprite_count = 0;
@@ -182,7 +558,7 @@ namespace Resources {
 	void sprite_sheet_copy_as_white(const std::string &name, const std::string &copy_from) {
 		auto sprite_sheet_index = sprite_sheet_map[copy_from];
 		SpriteSheet white_sheet = sprite_sheets[sprite_sheet_index];
-		sprite_load_white(name, white_sheet.sprite_sheet_name);
+		sprite_load_white(name, white_sheet.sprite_sheet_name)->pinned = true;
 		white_sheet.sprite_sheet_name = name;
 
 		auto index = sprite_sheets.size();
@@ -210,6 +586,10 @@ namespace Resources {
 		f->font = font;
 		f->name = name;
 		fonts[name] = f;
+		// built here rather than on first draw so the simulation thread never creates textures
+		if(font != NULL) {
+			TextCache::atlas_get(f);
+		}
 		return f;
 	}
 
@@ -218,16 +598,23 @@ namespace Resources {
 	}
 	
 	void font_set_style(const std::string &name, FontStyle style) {
-		TTF_SetFontStyle(fonts.at(name)->font, style);
+		Font *f = fonts.at(name);
+		TTF_SetFontStyle(f->font, style);
+		f->atlas = NULL;
+		TextCache::atlas_get(f);
 	}
 
 	void font_set_outline(const std::string &name, int outline) {
-		TTF_SetFontOutline(fonts.at(name)->font, outline);
+		Font *f = fonts.at(name);
+		TTF_SetFontOutline(f->font, outline);
+		f->atlas = NULL;
+		TextCache::atlas_get(f);
 	}
 
     void font_remove(const std::string& name) {
 		auto itr = fonts.find(name);
 		if (itr != fonts.end()) {
+			TextCache::font_clear(itr->second);
 			TTF_CloseFont(itr->second->font);
     		delete itr->second;
     		fonts.erase(itr);
@@ -236,62 +623,202 @@ namespace Resources {
 
     void cleanup() {
 		for(std::unordered_map<std::string, Sprite*>::iterator itr = sprites.begin(); itr != sprites.end(); itr++) {
-			SDL_DestroyTexture(itr->second->image);
+			sprite_unload(itr->second);
         	delete itr->second;
     	}
 		sprites.clear();
+		TextCache::clear();
 		for(std::unordered_map<std::string, Font*>::iterator itr = fonts.begin(); itr != fonts.end(); itr++) {
 			TTF_CloseFont(itr->second->font);
 			delete itr->second;
     	}
 		fonts.clear();
-
-		TextCache::clear();
 	}
 }
 
+// Printable ascii, anything else is drawn as '?'
+static const int GLYPH_FIRST = 32;
+static const int GLYPH_LAST = 126;
+static const int GLYPH_COUNT = GLYPH_LAST - GLYPH_FIRST + 1;
+static const int GLYPH_ATLAS_WIDTH = 512;
+
+// All glyphs of a font for one style and outline, rendered once in white.
+// Text is drawn glyph by glyph from the atlas with a color mod.
+struct GlyphAtlas {
+	int style;
+	int outline;
+	int height;
+	SDL_Texture *texture;
+	size_t bytes;
+	SDL_Rect glyphs[GLYPH_COUNT];
+	int advance[GLYPH_COUNT];
+	// empty if the font has no kerning
+	std::vector<int8_t> kerning;
+};
+
 namespace TextCache {
-	std::unordered_map<size_t, Sprite> text_cache;
-	std::hash<std::string> hasher;
+	static inline int glyph_index(char c) {
+		return (c >= GLYPH_FIRST && c <= GLYPH_LAST) ? c - GLYPH_FIRST : '?' - GLYPH_FIRST;
+	}
+
+	static GlyphAtlas *atlas_build(Font *font) {
+		GlyphAtlas *atlas = new GlyphAtlas;
+		atlas->style = TTF_GetFontStyle(font->font);
+		atlas->outline = TTF_GetFontOutline(font->font);
+		atlas->height = TTF_FontHeight(font->font);
+
+		// render each glyph like a one character string so offsets match TTF_RenderText
+		const SDL_Color white = { 255, 255, 255, 255 };
+		SDL_Surface *glyph_surfaces[GLYPH_COUNT];
+		int x = 0, y = 0, row_height = 0;
+		for(int i = 0; i < GLYPH_COUNT; i++) {
+			char text[2] = { (char)(GLYPH_FIRST + i), '\0' };
+			SDL_Surface *surface = TTF_RenderText_Solid(font->font, text, white);
+			glyph_surfaces[i] = surface;
+
+			int advance = 0;
+			TTF_GlyphMetrics(font->font, (Uint16)(GLYPH_FIRST + i), NULL, NULL, NULL, NULL, &advance);
+			atlas->advance[i] = advance;
+
+			int w = surface != NULL ? surface->w : 0;
+			int h = surface != NULL ? surface->h : 0;
+			if(x + w > GLYPH_ATLAS_WIDTH) {
+				x = 0;
+				y += row_height + 1;
+				row_height = 0;
+			}
+			atlas->glyphs[i] = { x, y, w, h };
+			x += w + 1;
+			row_height = h > row_height ? h : row_height;
+		}
+
+		SDL_Surface *atlas_surface = SDL_CreateRGBSurfaceWithFormat(0, GLYPH_ATLAS_WIDTH, y + row_height, 32, SDL_PIXELFORMAT_ARGB8888);
+		SDL_FillRect(atlas_surface, NULL, 0);
+		for(int i = 0; i < GLYPH_COUNT; i++) {
+			if(glyph_surfaces[i] != NULL) {
+				SDL_Rect dest = atlas->glyphs[i];
+				SDL_BlitSurface(glyph_surfaces[i], NULL, atlas_surface, &dest);
+				SDL_FreeSurface(glyph_surfaces[i]);
+			}
+		}
+		atlas->texture = SDL_CreateTextureFromSurface(renderer.renderer, atlas_surface);
+		SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+		// atlases are always resident but count against the budget
+		atlas->bytes = (size_t)atlas_surface->w * (size_t)atlas_surface->h * 4;
+		Resources::cache_track_pinned((int64_t)atlas->bytes);
+		SDL_FreeSurface(atlas_surface);
+
+		if(TTF_GetFontKerning(font->font)) {
+			bool has_kerning = false;
+			atlas->kerning.resize(GLYPH_COUNT * GLYPH_COUNT);
+			for(int a = 0; a < GLYPH_COUNT; a++) {
+				for(int b = 0; b < GLYPH_COUNT; b++) {
+					int k = TTF_GetFontKerningSizeGlyphs(font->font, (Uint16)(GLYPH_FIRST + a), (Uint16)(GLYPH_FIRST + b));
+					atlas->kerning[a * GLYPH_COUNT + b] = (int8_t)k;
+					has_kerning |= k != 0;
+				}
+			}
+			if(!has_kerning) {
+				atlas->kerning.clear();
+			}
+		}
 
-	static size_t cache_key(Font *font, const SDL_Color &color, const char *text) {
-		int colors = color.r | (color.g << 8) | (color.b << 16) | (color.a << 24);
-		return hasher(font->name + text + std::to_string(colors));
+		return atlas;
 	}
 
-	Sprite &load(Font *font, const SDL_Color &color, const char *text) {
-		size_t key = cache_key(font, color, text);
+	static GlyphAtlas *atlas_get(Font *font) {
+		if(font->atlas != NULL) {
+			return font->atlas;
+		}
 
-		auto item = text_cache.find(key);
-		if(item == text_cache.end()) {
-			Sprite ci;
-			SDL_Surface *surface = TTF_RenderText_Solid(font->font, text, color);
-			ci.image = SDL_CreateTextureFromSurface(renderer.renderer, surface);
-			SDL_FreeSurface(surface);
-			SDL_QueryTexture(ci.image, NULL, NULL, &ci.w, &ci.h);
-			text_cache[key] = ci;
-		} 
+		int style = TTF_GetFontStyle(font->font);
+		int outline = TTF_GetFontOutline(font->font);
+		for(auto atlas : font->atlases) {
+			if(atlas->style == style && atlas->outline == outline) {
+				font->atlas = atlas;
+				return atlas;
+			}
+		}
+
+		font->atlas = atlas_build(font);
+		font->atlases.push_back(font->atlas);
+		return font->atlas;
+	}
 
-		return text_cache[key];
+	static inline int kerning(const GlyphAtlas *atlas, int previous, int current) {
+		return atlas->kerning.empty() ? 0 : atlas->kerning[previous * GLYPH_COUNT + current];
+	}
+
+	void draw(Font *font, int x, int y, const SDL_Color &color, const char *text) {
+		PrimitiveBatch::flush();
+		GlyphAtlas *atlas = atlas_get(font);
+		submit_texture_mod(atlas->texture, color);
+
+		int pen = x;
+		int previous = -1;
+		for(const char *c = text; *c != '\0'; c++) {
+			int index = glyph_index(*c);
+			if(previous >= 0) {
+				pen += kerning(atlas, previous, index);
+			}
+			const SDL_Rect &src = atlas->glyphs[index];
+			if(src.w > 0) {
+				SDL_Rect dest = { pen, y, src.w, src.h };
+				submit_copy(atlas->texture, &src, dest);
+			}
+			pen += atlas->advance[index];
+			previous = index;
+		}
 	}
 
 	void size(Font *font, const char *text, int *w, int *h) {
-		TTF_SizeText(font->font, text, w, h);
+		GlyphAtlas *atlas = atlas_get(font);
+		int pen = 0;
+		int width = 0;
+		int previous = -1;
+		for(const char *c = text; *c != '\0'; c++) {
+			int index = glyph_index(*c);
+			if(previous >= 0) {
+				pen += kerning(atlas, previous, index);
+			}
+			int right = pen + atlas->glyphs[index].w;
+			width = right > width ? right : width;
+			pen += atlas->advance[index];
+			previous = index;
+		}
+		if(w != NULL) {
+			*w = pen > width ? pen : width;
+		}
+		if(h != NULL) {
+			*h = atlas->height;
+		}
 	}
 
 	void size(const char *text, int *w, int *h) {
-		TTF_SizeText(default_font->font, text, w, h);
+		size(default_font, text, w, h);
+	}
+
+	void font_clear(Font *font) {
+		for(auto atlas : font->atlases) {
+			Resources::cache_track_pinned(-(int64_t)atlas->bytes);
+			SDL_DestroyTexture(atlas->texture);
+			delete atlas;
+		}
+		font->atlases.clear();
+		font->atlas = NULL;
 	}
 
 	void clear() {
-		for(auto &cache_item : text_cache) {
-			SDL_DestroyTexture(cache_item.second.image);
+		for(auto &font : Resources::fonts) {
+			font_clear(font.second);
 		}
-		text_cache.clear();
 	}
 }
 
 void window_set_position(int x, int y) {
+	if(renderer.sdl_window == NULL) {
+		return;
+	}
 	SDL_SetWindowPosition(renderer.sdl_window, x, y);
 }
 
@@ -300,6 +827,9 @@ void window_center() {
 }
 
 void window_set_title(const char* title) {
+	if(renderer.sdl_window == NULL) {
+		return;
+	}
 	SDL_SetWindowTitle(renderer.sdl_window, title);
 }
 
@@ -311,12 +841,17 @@ void window_set_scale(const unsigned s) {
 	window_w = (int)(gw * s);
 	window_h = (int)(gh * s);
 	
-	SDL_SetWindowSize(renderer.sdl_window, window_w, window_h);
+	if(renderer.sdl_window != NULL) {
+		SDL_SetWindowSize(renderer.sdl_window, window_w, window_h);
+	}
 }
 
 static bool is_fullscreen = false;
 void window_toggle_fullscreen(bool useDesktopResolution) {
 	//GPU_SetFullscreen(!GPU_GetFullscreen(), useDesktopResolution);
+	if(renderer.sdl_window == NULL) {
+		return;
+	}
 	if(is_fullscreen) {
 		SDL_SetWindowFullscreen(renderer.sdl_window, 0);
 		is_fullscreen = false;
@@ -345,7 +880,8 @@ void draw_sprite(const Sprite *sprite, int x, int y) {
   	destination_rect.w = sprite->w;
   	destination_rect.h = sprite->h;
 
-	SDL_RenderCopy(renderer.renderer, sprite->image, NULL, &destination_rect);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, NULL, destination_rect);
 }
 
 void draw_sprite_centered(const Sprite *sprite, int x, int y) {
@@ -357,7 +893,8 @@ void draw_sprite_centered(const Sprite *sprite, int x, int y) {
   	destination_rect.w = w;
   	destination_rect.h = h;
 
-	SDL_RenderCopy(renderer.renderer, sprite->image, NULL, &destination_rect);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, NULL, destination_rect);
 }
 
 void draw_sprite_region(const Sprite *sprite, const SDL_Rect *src_rect, int x, int y) {
@@ -367,7 +904,8 @@ void draw_sprite_region(const Sprite *sprite, const SDL_Rect *src_rect, int x, i
   	destination_rect.w = src_rect->w;
   	destination_rect.h = src_rect->h;
 
-	SDL_RenderCopy(renderer.renderer, sprite->image, src_rect, &destination_rect);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, src_rect, destination_rect);
 }
 
 void draw_sprite_region_centered(const Sprite *sprite, const SDL_Rect *src_rect, int x, int y) {
@@ -379,7 +917,8 @@ void draw_sprite_region_centered(const Sprite *sprite, const SDL_Rect *src_rect,
   	destination_rect.w = w;
   	destination_rect.h = h;
 
-	SDL_RenderCopy(renderer.renderer, sprite->image, src_rect, &destination_rect);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, src_rect, destination_rect);
 }
 
 void draw_sprite_region_centered_rotated(const Sprite *sprite, const SDL_Rect *src_rect, int x, int y, float angle) {
@@ -391,7 +930,8 @@ void draw_sprite_region_centered_rotated(const Sprite *sprite, const SDL_Rect *s
   	destination_rect.w = w;
   	destination_rect.h = h;
 
-	SDL_RenderCopyEx(renderer.renderer, sprite->image, src_rect, &destination_rect, angle, NULL, SDL_FLIP_NONE);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, src_rect, destination_rect, angle);
 }
 
 void draw_sprite_region_centered_ex(const Sprite *sprite, const SDL_Rect *src_rect, int x, int y, int w, int h, float angle) {
@@ -401,7 +941,8 @@ void draw_sprite_region_centered_ex(const Sprite *sprite, const SDL_Rect *src_re
   	destination_rect.w = w;
   	destination_rect.h = h;
 
-	SDL_RenderCopyEx(renderer.renderer, sprite->image, src_rect, &destination_rect, angle, NULL, SDL_FLIP_NONE);
+	PrimitiveBatch::flush();
+	submit_copy(sprite->image, src_rect, destination_rect, angle);
 }
 
 void draw_spritesheet_name(const SpriteSheet &s, const std::string &sprite, const int &x, const int &y) {
@@ -429,8 +970,7 @@ void draw_text_str(int x, int y, const SDL_Color &color, const std::string text)
 }
 
 void draw_text_font(Font *font, int x, int y, const SDL_Color &color, const char *text) {
-	Sprite &cacheItem = TextCache::load(font, color, text);
-	draw_sprite(&cacheItem, x, y);
+	TextCache::draw(font, x, y, color, text);
 }
 
 void draw_text_centered(int x, int y, const SDL_Color &color, const char *text) {
@@ -446,21 +986,15 @@ void draw_text_right_str(int x, int y, const SDL_Color &color, std::string text)
 }
 
 void draw_text_font_centered(Font *font, int x, int y, const SDL_Color &color, const char *text) {
-	Sprite &cacheItem = TextCache::load(font, color, text);
-	draw_sprite_centered(&cacheItem, x, y);
-	// SDL_Rect destination_rect;
-	// destination_rect.x = x - (cacheItem.w / 2);
- 	// destination_rect.y = y - (cacheItem.h / 2);
-	// destination_rect.w = cacheItem.w;
-	// destination_rect.h = cacheItem.h;
-
-	// SDL_RenderCopy(renderer.renderer, cacheItem.image, NULL, &destination_rect);
+	int w, h;
+	TextCache::size(font, text, &w, &h);
+	TextCache::draw(font, x - (w / 2), y - (h / 2), color, text);
 }
 
 void draw_text_font_right_aligned(Font *font, int x, int y, const SDL_Color &color, const char *text) {
-	Sprite &cacheItem = TextCache::load(font, color, text);
-	x -= cacheItem.w;
-	draw_sprite(&cacheItem, x, y);
+	int w;
+	TextCache::size(font, text, &w, NULL);
+	TextCache::draw(font, x - w, y, color, text);
 }
 
 void draw_tilemap_ortho(const TileMap &t, const SpriteSheet &s, const int x_start, const int y_start) {
@@ -476,8 +1010,177 @@ void draw_tilemap_ortho(const TileMap &t, const SpriteSheet &s, const int x_star
 	}
 }
 
+void tilemap_chunks_init(TileMapChunks &chunks, const TileMap &t, const SpriteSheet &s) {
+	tilemap_chunks_free(chunks);
+	chunks.tile_map = &t;
+	chunks.sheet = &s;
+	chunks.chunks_x = (t.columns + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	chunks.chunks_y = (t.rows + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	chunks.chunk_texture.assign(chunks.chunks_x * chunks.chunks_y, -1);
+	chunks.dirty.assign(chunks.chunks_x * chunks.chunks_y, 1);
+
+	int max_id = 0;
+	for(auto &frame : s.sheet_sprites) {
+		max_id = frame.id > max_id ? frame.id : max_id;
+	}
+	chunks.tile_regions.assign(max_id + 1, SDL_Rect { 0, 0, 0, 0 });
+	for(auto &frame : s.sheet_sprites) {
+		if(frame.id >= 0) {
+			chunks.tile_regions[frame.id] = frame.region;
+		}
+	}
+
+	// enough to cover the view when it straddles chunk edges, created here so
+	// drawing never has to create textures
+	const int chunk_pixels = TILEMAP_CHUNK_SIZE * t.tile_size;
+	int pool_x = gw / chunk_pixels + 2;
+	int pool_y = gh / chunk_pixels + 2;
+	int pool_size = std::min(pool_x * pool_y, (int)(chunks.chunks_x * chunks.chunks_y));
+	for(int i = 0; i < pool_size; i++) {
+		SDL_Texture *texture = SDL_CreateTexture(renderer.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, chunk_pixels, chunk_pixels);
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		chunks.pool.push_back(texture);
+		chunks.pool_chunk.push_back(-1);
+		chunks.pool_last_used.push_back(0);
+	}
+}
+
+void tilemap_chunks_mark_dirty(TileMapChunks &chunks, unsigned x, unsigned y) {
+	chunks.dirty[(y / TILEMAP_CHUNK_SIZE) * chunks.chunks_x + (x / TILEMAP_CHUNK_SIZE)] = 1;
+}
+
+void tilemap_chunks_free(TileMapChunks &chunks) {
+	for(auto texture : chunks.pool) {
+		SDL_DestroyTexture(texture);
+	}
+	chunks.pool.clear();
+	chunks.pool_chunk.clear();
+	chunks.pool_last_used.clear();
+	chunks.chunk_texture.clear();
+	chunks.dirty.clear();
+	chunks.tile_regions.clear();
+}
+
+void render_layer_init(RenderLayer &layer, int w, int h) {
+	render_layer_free(layer);
+	layer.texture = SDL_CreateTexture(renderer.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+	SDL_SetTextureBlendMode(layer.texture, SDL_BLENDMODE_BLEND);
+	layer.w = w;
+	layer.h = h;
+	layer.dirty = true;
+}
+
+void render_layer_begin(RenderLayer &layer) {
+	ASSERT_WITH_MSG(layer.texture != NULL, "render_layer_begin: layer is not initialized");
+	PrimitiveBatch::flush();
+	submit_target(layer.texture);
+	submit_clear(SDL_Color { 0, 0, 0, 0 });
+}
+
+void render_layer_end(RenderLayer &layer) {
+	PrimitiveBatch::flush();
+	submit_target(renderer.renderTarget);
+	layer.dirty = false;
+}
+
+void render_layer_free(RenderLayer &layer) {
+	if(layer.texture != NULL) {
+		SDL_DestroyTexture(layer.texture);
+		layer.texture = NULL;
+	}
+	layer.w = layer.h = 0;
+	layer.dirty = true;
+}
+
+static void tilemap_chunk_bake(TileMapChunks &chunks, unsigned chunk_x, unsigned chunk_y, SDL_Texture *texture) {
+	const TileMap &t = *chunks.tile_map;
+	const unsigned x_end = std::min((chunk_x + 1) * TILEMAP_CHUNK_SIZE, t.columns);
+	const unsigned y_end = std::min((chunk_y + 1) * TILEMAP_CHUNK_SIZE, t.rows);
+	SDL_Texture *sheet_texture = Resources::sprite_get(chunks.sheet->sprite_sheet_name)->image;
+	SDL_Texture *previous_target = submitted_target;
+
+	PrimitiveBatch::flush();
+	submit_target(texture);
+	submit_clear(SDL_Color { 0, 0, 0, 0 });
+	for(unsigned layer = 0; layer < t.layers; layer++) {
+		for(unsigned y = chunk_y * TILEMAP_CHUNK_SIZE; y < y_end; y++) {
+			for(unsigned x = chunk_x * TILEMAP_CHUNK_SIZE; x < x_end; x++) {
+				unsigned tile = t.tiles[Tiling::tilemap_index(t, layer, x, y)];
+				if(tile >= chunks.tile_regions.size() || chunks.tile_regions[tile].w == 0) {
+					continue;
+				}
+				const SDL_Rect &src = chunks.tile_regions[tile];
+				SDL_Rect dest = { 
+					(int)((x - chunk_x * TILEMAP_CHUNK_SIZE) * t.tile_size), 
+					(int)((y - chunk_y * TILEMAP_CHUNK_SIZE) * t.tile_size), 
+					src.w, src.h };
+				submit_copy(sheet_texture, &src, dest);
+			}
+		}
+	}
+	// back to whatever the tile map is being drawn into, could be a render layer
+	submit_target(previous_target);
+}
+
+void draw_tilemap_chunks(TileMapChunks &chunks, const int x_start, const int y_start) {
+	if(chunks.tile_map == NULL || chunks.pool.empty()) {
+		return;
+	}
+	chunks.frame++;
+	// primitives queued before must land under the tiles, not on top
+	PrimitiveBatch::flush();
+
+	const Vector2 camera = camera_render_position();
+	const int chunk_pixels = TILEMAP_CHUNK_SIZE * chunks.tile_map->tile_size;
+	const int view_x = (int)camera.x - x_start;
+	const int view_y = (int)camera.y - y_start;
+	const int first_x = std::max(0, (int)Math::floor_f((float)view_x / chunk_pixels));
+	const int first_y = std::max(0, (int)Math::floor_f((float)view_y / chunk_pixels));
+	const int last_x = std::min((int)chunks.chunks_x - 1, (int)Math::floor_f((float)(view_x + (int)gw) / chunk_pixels));
+	const int last_y = std::min((int)chunks.chunks_y - 1, (int)Math::floor_f((float)(view_y + (int)gh) / chunk_pixels));
+
+	for(int chunk_y = first_y; chunk_y <= last_y; chunk_y++) {
+		for(int chunk_x = first_x; chunk_x <= last_x; chunk_x++) {
+			const int chunk = chunk_y * chunks.chunks_x + chunk_x;
+			int pool_index = chunks.chunk_texture[chunk];
+			if(pool_index < 0) {
+				// take the texture drawn longest ago
+				pool_index = 0;
+				for(int i = 1; i < (int)chunks.pool.size(); i++) {
+					if(chunks.pool_last_used[i] < chunks.pool_last_used[pool_index]) {
+						pool_index = i;
+					}
+				}
+				if(chunks.pool_chunk[pool_index] >= 0) {
+					chunks.chunk_texture[chunks.pool_chunk[pool_index]] = -1;
+				}
+				chunks.pool_chunk[pool_index] = chunk;
+				chunks.chunk_texture[chunk] = pool_index;
+				chunks.dirty[chunk] = 1;
+			}
+			if(chunks.dirty[chunk]) {
+				tilemap_chunk_bake(chunks, chunk_x, chunk_y, chunks.pool[pool_index]);
+				chunks.dirty[chunk] = 0;
+			}
+			chunks.pool_last_used[pool_index] = chunks.frame;
+
+			SDL_Rect dest = { x_start + chunk_x * chunk_pixels - (int)camera.x, y_start + chunk_y * chunk_pixels - (int)camera.y, chunk_pixels, chunk_pixels };
+			submit_copy(chunks.pool[pool_index], NULL, dest);
+		}
+	}
+}
+
+void draw_render_layer(const RenderLayer &layer, int x, int y) {
+	if(layer.texture == NULL) {
+		return;
+	}
+	PrimitiveBatch::flush();
+	SDL_Rect dest = { x, y, layer.w, layer.h };
+	submit_copy(layer.texture, NULL, dest);
+}
+
 void draw_g_pixel(int x, int y) {
-    SDL_RenderDrawPoint(renderer.renderer, x, y);
+	PrimitiveBatch::point(x, y);
 }
 
 void draw_g_pixel_color(int x, int y, const SDL_Color &color) {
@@ -485,23 +1188,27 @@ void draw_g_pixel_color(int x, int y, const SDL_Color &color) {
 }
 
 void draw_g_pixel_RGBA(int x, int y, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a);
-    SDL_RenderDrawPoint(renderer.renderer, x, y);
+	PrimitiveBatch::set_color(r, g, b, a);
+	PrimitiveBatch::point(x, y);
 }
 
 void draw_g_line(int x1, int y1, int x2, int y2) {
-    SDL_RenderDrawLine(renderer.renderer, x1, y1, x2, y2);
+	if(y1 == y2) {
+		PrimitiveBatch::horizontal_line(x1, x2, y1);
+	} else if(x1 == x2) {
+		PrimitiveBatch::vertical_line(x1, y1, y2);
+	} else {
+		PrimitiveBatch::line(x1, y1, x2, y2);
+	}
 }
 
 void draw_g_line_RGBA(int x1, int y1, int x2, int y2, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a);
+	PrimitiveBatch::set_color(r, g, b, a);
 	draw_g_line(x1, y1, x2, y2);
 }
 
 void draw_g_horizontal_line(int x1, int x2, int y) {
-    SDL_RenderDrawLine(renderer.renderer, x1, y, x2, y);
+	PrimitiveBatch::horizontal_line(x1, x2, y);
 }
 
 void draw_g_horizontal_line_color(int x1, int x2, int y, SDL_Color &color) {
@@ -509,9 +1216,8 @@ void draw_g_horizontal_line_color(int x1, int x2, int y, SDL_Color &color) {
 }
 
 void draw_g_horizontal_line_RGBA(int x1, int x2, int y, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a);
-    SDL_RenderDrawLine(renderer.renderer, x1, y, x2, y);        
+	PrimitiveBatch::set_color(r, g, b, a);
+	PrimitiveBatch::horizontal_line(x1, x2, y);
 }
 
 void draw_g_vertical_line_color(int x, int y1, int y2, SDL_Color &color) {
@@ -519,9 +1225,8 @@ void draw_g_vertical_line_color(int x, int y1, int y2, SDL_Color &color) {
 }
 
 void draw_g_vertical_line_RGBA(int x, int y1, int y2, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-    SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a);
-    SDL_RenderDrawLine(renderer.renderer, x, y1, x, y2);
+	PrimitiveBatch::set_color(r, g, b, a);
+	PrimitiveBatch::vertical_line(x, y1, y2);
 }
 
 void draw_g_circle_color(int x, int y, int rad, SDL_Color &color) {
@@ -681,8 +1386,7 @@ void draw_g_ellipseRGBA(int x, int y, int rx, int ry, uint8_t r, uint8_t g, uint
         /*
         * Set color
         */
-        SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-        SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a);
+        PrimitiveBatch::set_color(r, g, b, a);
 
         /*
         * Init vars 
@@ -791,10 +1495,16 @@ void draw_g_rectangle(int x, int y, int w, int h, const SDL_Color &color) {
 }
 
 void draw_g_rectangle_RGBA(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a); 
-	SDL_Rect rect = { x, y, w, h };
-	SDL_RenderDrawRect(renderer.renderer, &rect);
+	PrimitiveBatch::set_color(r, g, b, a);
+	// edges don't overlap so blended outlines don't get darker corners
+	PrimitiveBatch::rect(x, y, w, 1);
+	if(h > 1) {
+		PrimitiveBatch::rect(x, y + h - 1, w, 1);
+	}
+	PrimitiveBatch::rect(x, y + 1, 1, h - 2);
+	if(w > 1) {
+		PrimitiveBatch::rect(x + w - 1, y + 1, 1, h - 2);
+	}
 }
 
 void draw_g_rectangle_filled(int x, int y, int w, int h, const SDL_Color &color) {
@@ -802,35 +1512,59 @@ void draw_g_rectangle_filled(int x, int y, int w, int h, const SDL_Color &color)
 }
 
 void draw_g_rectangle_filled_RGBA(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	SDL_SetRenderDrawBlendMode(renderer.renderer, (a == 255) ? SDL_BLENDMODE_NONE : SDL_BLENDMODE_BLEND);
-	SDL_SetRenderDrawColor(renderer.renderer, r, g, b, a); 
-	SDL_Rect rect = { x, y, w, h };
-	SDL_RenderFillRect(renderer.renderer, &rect);
+	PrimitiveBatch::set_color(r, g, b, a);
+	PrimitiveBatch::rect(x, y, w, h);
 }
 
 void draw_buffer(const RenderBuffer &render_buffer) {
 	const SpriteBufferData *spr = render_buffer.sprite_data_buffer;
 	const int length = render_buffer.sprite_count;
 
+	PROFILE_SCOPE("draw buffer");
+	PrimitiveBatch::flush();
     for(int i = 0; i < length; i++) {
-        SDL_RenderCopyEx(renderer.renderer, spr[i].tex, &spr[i].src, &spr[i].dest, spr[i].angle, spr[i].center, spr[i].flip);
+        submit_copy(spr[i].tex, &spr[i].src, spr[i].dest, spr[i].angle, spr[i].center, spr[i].flip);
     }
 }
 
-int renderer_init(const char *title, unsigned vw, unsigned vh, unsigned scale) {
-	gw = vw;
-	gh = vh;
-	step_scale = scale;
-	window_w = gw * step_scale;
-	window_h = gh * step_scale;
-	windowPos = SDL_WINDOWPOS_CENTERED;
+static bool headless = false;
+
+void renderer_set_headless(bool h) {
+	headless = h;
+}
 
+bool renderer_is_headless() {
+	return headless;
+}
+
+static int renderer_init_headless() {
+	SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		printf("Could not initialize: %s\n", SDL_GetError());
+		return 0;
+	}
+
+	renderer.sdl_window = NULL;
+	renderer.screen = SDL_CreateRGBSurfaceWithFormat(0, window_w, window_h, 32, SDL_PIXELFORMAT_ARGB8888);
+	if(renderer.screen == NULL) {
+		printf("Could not create offscreen surface: %s\n", SDL_GetError());
+		return 0;
+	}
+	renderer.renderer = SDL_CreateSoftwareRenderer(renderer.screen);
+	if(renderer.renderer == NULL) {
+		printf("Could not create software renderer: %s\n", SDL_GetError());
+		return 0;
+	}
+	return 1;
+}
+
+static int renderer_init_window(const char *title) {
 	// SDL_INIT_AUDIO
 	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
 		printf("Could not initialize: %s\n", SDL_GetError());
-		return -1;
-	} 
-	
+		return 0;
+	}
+
 	renderer.sdl_window = SDL_CreateWindow(title, 
 		windowPos, 
 		windowPos, 
@@ -848,6 +1582,27 @@ int renderer_init(const char *title, unsigned vw, unsigned vh, unsigned scale) {
 	Uint32 flags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE;
 	// Uint32 flags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE;
 	renderer.renderer = SDL_CreateRenderer(renderer.sdl_window, -1, flags);
+	return 1;
+}
+
+int renderer_init(const char *title, unsigned vw, unsigned vh, unsigned scale) {
+	gw = vw;
+	gh = vh;
+	step_scale = scale;
+	window_w = gw * step_scale;
+	window_h = gh * step_scale;
+	windowPos = SDL_WINDOWPOS_CENTERED;
+
+	const char *headless_env = SDL_getenv("SDLECS_HEADLESS");
+	if(headless_env != NULL && headless_env[0] != '\0' && headless_env[0] != '0') {
+		headless = true;
+	}
+
+	renderer.screen = NULL;
+	int result = headless ? renderer_init_headless() : renderer_init_window(title);
+	if(!result) {
+		return 0;
+	}
 
     renderer.clearColor = { 0, 0, 0, 255 };
 	SDL_SetRenderDrawColor(renderer.renderer, 0x00, 0x00, 0x00, 0xFF ); 
@@ -889,53 +1644,63 @@ int renderer_init(const char *title, unsigned vw, unsigned vh, unsigned scale) {
 	
 	// camera = GPU_GetDefaultCamera();
 
-	SDL_ShowWindow(renderer.sdl_window);
+	if(!headless) {
+		SDL_ShowWindow(renderer.sdl_window);
+	}
 
     return 1;
 }
 
+bool renderer_save_png(const char *filename) {
+	PrimitiveBatch::flush();
+	SDL_Texture *current_target = SDL_GetRenderTarget(renderer.renderer);
+	SDL_SetRenderTarget(renderer.renderer, NULL);
+
+	int w, h;
+	SDL_GetRendererOutputSize(renderer.renderer, &w, &h);
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+	bool saved = surface != NULL
+		&& SDL_RenderReadPixels(renderer.renderer, NULL, SDL_PIXELFORMAT_ARGB8888, surface->pixels, surface->pitch) == 0
+		&& IMG_SavePNG(surface, filename) == 0;
+	if(!saved) {
+		Engine::logn("renderer_save_png, could not save '%s': %s", filename, SDL_GetError());
+	}
+	SDL_FreeSurface(surface);
+
+	SDL_SetRenderTarget(renderer.renderer, current_target);
+	return saved;
+}
+
 void renderer_set_clear_color(const SDL_Color &color) {
     renderer.clearColor = color;
 }
 
 void renderer_set_color(const SDL_Color &color) {
-	SDL_SetRenderDrawColor(renderer.renderer, color.r, color.g, color.b, color.a);
+	PrimitiveBatch::set_color(color.r, color.g, color.b, color.a);
 }
 
 void renderer_clear() {
-	renderer_set_color(renderer.clearColor);
-	SDL_SetRenderTarget(renderer.renderer, renderer.renderTarget);
-	SDL_RenderClear(renderer.renderer);
+	PrimitiveBatch::flush();
+	submit_target(renderer.renderTarget);
+	submit_clear(renderer.clearColor);
 }
 
 void renderer_draw_render_target() {
-	SDL_SetRenderTarget(renderer.renderer, NULL);
+	PrimitiveBatch::flush();
+	submit_target(NULL);
 	
 	// USE TO CREATE BLACK BARS (That can be filled with other things if we want)
-	SDL_Rect destination_rect;
-	destination_rect.x = (window_w / 2) - (gw * step_scale / 2);
- 	destination_rect.y = (window_h / 2) - (gh * step_scale / 2);
-  	destination_rect.w = gw * step_scale;
-  	destination_rect.h = gh * step_scale;
-	SDL_RenderCopy(renderer.renderer, renderer.renderTarget, NULL, &destination_rect);
+	submit_copy_to_window(renderer.renderTarget, 0, 0);
 	
 	// USE TO STRETCH TO FILL SCREEN
 	// SDL_RenderCopy(renderer.renderer, renderer.renderTarget, NULL, NULL);
 }
 
 void renderer_draw_render_target_camera() {
-	camera_update();
-
-	SDL_Rect destination_rect;
-	auto x_pos = (window_w / 2) - (int)(gw * step_scale / 2) + camera.offset_x;
-	auto y_pos = (window_h / 2) - (int)(gh * step_scale / 2) + camera.offset_y;
-	destination_rect.x = (int)x_pos;
- 	destination_rect.y = (int)y_pos;
-  	destination_rect.w = gw * step_scale;
-  	destination_rect.h = gh * step_scale;
-
-	SDL_SetRenderTarget(renderer.renderer, NULL);
-	SDL_RenderCopy(renderer.renderer, renderer.renderTarget, NULL, &destination_rect);
+	PrimitiveBatch::flush();
+	submit_target(NULL);
+	// floor matches truncating the whole position while it is on screen
+	submit_copy_to_window(renderer.renderTarget, (int)floorf(camera.offset_x), (int)floorf(camera.offset_y));
 }
 
 static void framelog_render() {
@@ -946,23 +1711,200 @@ static void framelog_render() {
 	const Point &p = FrameLog::get_position();
 	int y = p.y;
     for(const auto &m : messages) {
-        draw_text_str(p.x, y, Colors::white, m);
+        draw_text(p.x, y, Colors::white, m.c_str());
         y += 15;
     }
 }
 
+// zone name indented by depth, then ms per frame as min / mean / max
+static void profiler_render() {
+	if(!Profiler::is_enabled()) {
+		return;
+	}
+	char line[96];
+	int y = 5;
+	for(const auto &zone : Profiler::zone_stats()) {
+		snprintf(line, sizeof(line), "%*s%s %.2f / %.2f / %.2f x%u", zone.depth * 2, "", zone.name, zone.min_ms, zone.mean_ms, zone.max_ms, zone.calls);
+		draw_text(gw - 260, y, Colors::white, line);
+		y += 15;
+	}
+}
+
+static const char *perf_hud_names[PerfHud::TimingCount] = { "frame", "update", "render" };
+
+// Percentiles and a sparkline of the last samples for each timing, then the
+// counters and gauges. Text goes through the glyph atlas from stack buffers
+// and the bars through the primitive batch so drawing allocates nothing.
+static void perf_hud_render() {
+	if(!PerfHud::is_enabled()) {
+		return;
+	}
+	// what was batched before belongs to the frame, the flush at the end is the hud's own
+	PrimitiveBatch::flush();
+	const uint64_t start = SDL_GetPerformanceCounter();
+	const int spark_samples = 128;
+	const int spark_height = 12;
+	const int x = FrameLog::get_position().x;
+	int y = FrameLog::get_position().y + (FrameLog::is_enabled() ? (int)FrameLog::get_messages().size() * 15 : 0);
+	// bars are full height at twice the frame budget
+	const int fps = FramePacer::target_fps() > 0 ? FramePacer::target_fps() : 60;
+	const float budget_ms = 1000.0f / fps;
+
+	char line[64];
+	for(int t = 0; t < PerfHud::TimingCount; t++) {
+		const PerfHud::Percentiles p = PerfHud::percentiles((PerfHud::Timing)t);
+		snprintf(line, sizeof(line), "%s %.1f / %.1f / %.1f ms", perf_hud_names[t], p.p50, p.p95, p.p99);
+		draw_text(x, y, Colors::white, line);
+
+		const PerfHud::TimingHistory &h = PerfHud::history((PerfHud::Timing)t);
+		const int count = (int)(h.written < (uint32_t)spark_samples ? h.written : spark_samples);
+		const int spark_x = x + 170 + spark_samples - count;
+		const int bottom = y + spark_height;
+		// over budget in a second pass so the batch isn't broken by every color change
+		for(int pass = 0; pass < 2; pass++) {
+			for(int i = 0; i < count; i++) {
+				const float ms = h.samples[(h.written - count + i) % PerfHud::HISTORY];
+				if((ms > budget_ms) != (pass == 1)) {
+					continue;
+				}
+				int bar = (int)(ms / (budget_ms * 2) * spark_height);
+				bar = bar < 1 ? 1 : (bar > spark_height ? spark_height : bar);
+				if(pass == 0) {
+					draw_g_rectangle_filled_RGBA(spark_x + i, bottom - bar, 1, bar, 82, 201, 90, 255);
+				} else {
+					draw_g_rectangle_filled_RGBA(spark_x + i, bottom - bar, 1, bar, 201, 82, 82, 255);
+				}
+			}
+		}
+		draw_g_line_RGBA(x + 170, bottom - spark_height / 2, x + 170 + spark_samples, bottom - spark_height / 2, 255, 255, 255, 80);
+		y += 15;
+	}
+
+	for(int i = 0; i < PerfHud::value_count(); i++) {
+		const PerfHud::Value &v = PerfHud::value(i);
+		if(v.is_gauge) {
+			snprintf(line, sizeof(line), "%s %.3f", v.name, v.gauge);
+		} else {
+			snprintf(line, sizeof(line), "%s %lld", v.name, (long long)v.counter);
+		}
+		draw_text(x, y, Colors::white, line);
+		y += 15;
+	}
+
+	if(Allocations::is_enabled()) {
+		Allocations::LabelCounts top[3];
+		const int count = Allocations::last_frame_labels(top, 3);
+		for(int i = 0; i < count; i++) {
+			snprintf(line, sizeof(line), "allocs %s %d (%d b)", top[i].name, (int)top[i].counts.count, (int)top[i].counts.bytes);
+			draw_text(x, y, Colors::yellow, line);
+			y += 15;
+		}
+	}
+	PrimitiveBatch::flush();
+	PerfHud::exclude(SDL_GetPerformanceCounter() - start);
+}
+
 void renderer_flip() {
+	PROFILE_SCOPE("flip");
 	framelog_render();
+	profiler_render();
+	perf_hud_render();
+	PrimitiveBatch::flush();
+	FlightRecorder::counter("draw calls", frame_draw_calls);
+	frame_draw_calls = 0;
+	if(Pipeline::recording) {
+		renderer_pipeline_publish();
+		return;
+	}
     //GPU_Flip(renderer.screen);
 	SDL_RenderPresent(renderer.renderer);
 }
 
+void renderer_pipeline_start() {
+	// bring back evicted textures while still on the main thread
+	for(auto &entry : Resources::sprites) {
+		if(entry.second->image == NULL && !entry.second->filename.empty()) {
+			Resources::sprite_reload(entry.second);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(Pipeline::mutex);
+	for(auto &frame : Pipeline::frames) {
+		frame.clear();
+	}
+	Pipeline::ready_fresh = false;
+	Pipeline::stopped = false;
+	Pipeline::recording = true;
+}
+
+void renderer_pipeline_stop() {
+	{
+		std::lock_guard<std::mutex> lock(Pipeline::mutex);
+		Pipeline::stopped = true;
+	}
+	Pipeline::frame_changed.notify_all();
+}
+
+void renderer_pipeline_end() {
+	renderer_pipeline_stop();
+	Pipeline::recording = false;
+}
+
+bool renderer_pipeline_enabled() {
+	return Pipeline::recording;
+}
+
+void renderer_pipeline_stamp(uint64_t timestamp) {
+	Pipeline::frames[Pipeline::write_index].timestamp = timestamp;
+}
+
+void renderer_pipeline_publish() {
+	std::unique_lock<std::mutex> lock(Pipeline::mutex);
+	// stay at most one frame ahead of what is presented
+	Pipeline::frame_changed.wait(lock, [] { return !Pipeline::ready_fresh || Pipeline::stopped; });
+	std::swap(Pipeline::write_index, Pipeline::ready_index);
+	Pipeline::ready_fresh = true;
+	lock.unlock();
+	Pipeline::frame_changed.notify_all();
+
+	Pipeline::frames[Pipeline::write_index].clear();
+}
+
+bool renderer_pipeline_present(uint64_t *timestamp) {
+	{
+		std::unique_lock<std::mutex> lock(Pipeline::mutex);
+		bool has_frame = Pipeline::frame_changed.wait_for(lock, std::chrono::milliseconds(100), [] { return Pipeline::ready_fresh || Pipeline::stopped; });
+		if(!has_frame || !Pipeline::ready_fresh) {
+			return false;
+		}
+		std::swap(Pipeline::read_index, Pipeline::ready_index);
+		Pipeline::ready_fresh = false;
+	}
+	Pipeline::frame_changed.notify_all();
+
+	PROFILE_SCOPE("present");
+	const Pipeline::Frame &frame = Pipeline::frames[Pipeline::read_index];
+	for(const auto &c : frame.commands) {
+		execute(c, frame.rects.data(), frame.points.data());
+	}
+	SDL_RenderPresent(renderer.renderer);
+	if(timestamp != NULL) {
+		*timestamp = frame.timestamp;
+	}
+	return true;
+}
+
 void renderer_destroy() {
 	Resources::cleanup();
 	IMG_Quit();
 	TTF_Quit();
 	SDL_DestroyRenderer(renderer.renderer);
-	SDL_DestroyWindow(renderer.sdl_window);
+	if(renderer.sdl_window != NULL) {
+		SDL_DestroyWindow(renderer.sdl_window);
+	}
+	if(renderer.screen != NULL) {
+		SDL_FreeSurface(renderer.screen);
+	}
 }
 
 const Camera &get_camera() {
@@ -977,6 +1919,8 @@ void camera_follow(Vector2 position) {
 void camera_lookat(Vector2 position) {
 	camera.x = (float)(position.x - (gw / 2));
 	camera.y = (float)(position.y - (gh / 2));
+	camera.last_x = camera.x;
+	camera.last_y = camera.y;
 	camera.follow_x = camera.x;
 	camera.follow_y = camera.y;
 }
@@ -1015,7 +1959,14 @@ static const float maxAngle = 5; // degrees // maxAngle might be something like
 static const float maxOffsetX = 10; // pixels
 static const float maxOffsetY = 10; // pixels
 
+Vector2 camera_render_position() {
+	return Vector2(Math::lerp(camera.last_x, camera.x, Time::alpha), Math::lerp(camera.last_y, camera.y, Time::alpha));
+}
+
 void camera_update() {
+	camera.last_x = camera.x;
+	camera.last_y = camera.y;
+
 	float interpolation = camera.speed * Time::delta_time;
 	camera.x = Math::lerp(camera.x, camera.follow_x, interpolation);
 	camera.y = Math::lerp(camera.y, camera.follow_y, interpolation);
@@ -4,6 +4,7 @@
 #include "engine.h"
 #include "SDL_ttf.h"
 #include <unordered_map>
+#include <algorithm>
 
 // prefered display to show the window
 #ifndef PREFERRED_DISPLAY
@@ -16,6 +17,8 @@ extern unsigned gh;
 typedef struct {
 	SDL_Window *sdl_window;
     SDL_Renderer *renderer;
+	// offscreen surface the software renderer draws to when headless
+	SDL_Surface *screen;
     SDL_Texture *renderTarget;
     SDL_Color default_color;
     SDL_Color clearColor;
@@ -28,6 +31,9 @@ struct Camera {
 	float trauma = 0.0f;
 	float x = 0;
 	float y = 0;
+	// position before the last update, render lerps from here
+	float last_x = 0;
+	float last_y = 0;
 	float offset_x = 0;
 	float offset_y = 0;
     float follow_x = 0;
@@ -49,6 +55,28 @@ struct Sprite {
     bool isValid() {
         return image != NULL;
     }
+
+    // resource cache bookkeeping, image is NULL while evicted
+    std::string filename;
+    bool white = false;
+    bool pinned = false;
+    int references = 0;
+    size_t bytes = 0;
+    uint64_t last_used = 0;
+};
+
+// Holding a handle keeps the texture resident, release it when done
+struct SpriteHandle {
+    Sprite *sprite = NULL;
+};
+
+struct ResourceCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    // estimated texture memory, w * h * 4 per texture
+    size_t resident_bytes = 0;
+    size_t budget_bytes = 0;
 };
 
 struct SpriteFrame {
@@ -64,20 +92,35 @@ struct SpriteSheet {
 	std::unordered_map<std::string, int> sprites_by_name;
 };
 
+struct GlyphAtlas;
+
 struct Font {
     TTF_Font *font;
     std::string name;
+	// atlas for the current style and outline, built on first use
+	GlyphAtlas *atlas = NULL;
+	std::vector<GlyphAtlas*> atlases;
 	inline void set_color(const SDL_Color &color) {
 		//font->setDefaultColor(color);
 	}
 };
 
+// Sprites are kept under a byte budget, least recently used textures that are
+// not pinned or referenced by a handle are evicted and reloaded on the next get.
+// Sprite pointers stay valid, only the texture goes away.
+// Sprite sheets are pinned since animation frames keep their texture pointers.
 namespace Resources {
     Sprite *sprite_load(const std::string &name, const std::string &filename);
     Sprite *sprite_load_white(const std::string &name, const std::string &filename);
     Sprite *sprite_get(const std::string &name);
     SDL_Rect &sprite_get_from_sheet(const size_t &sprite_sheet_index, const std::string &name);
     void sprite_remove(const std::string &name);
+    SpriteHandle sprite_acquire(const std::string &name);
+    void sprite_release(SpriteHandle &handle);
+
+    void cache_set_budget(size_t bytes);
+    void cache_trim();
+    const ResourceCacheStats &cache_stats();
 
     Font *font_load(const std::string name, const std::string filename, int pointSize);
     Font *font_get(const std::string &name);
@@ -90,9 +133,8 @@ namespace Resources {
 		UNDERLINE = 0x04,
 		STRIKETHROUGH = 0x08
 	};
-    // Styles must be set before drawing text with that font to cache correctly
+    // Each style and outline combination gets its own glyph atlas
     void font_set_style(const std::string &name, FontStyle style);
-    // Outlines must be set before drawing text with that font to cache correctly
     void font_set_outline(const std::string &name, int outline);
 
     void sprite_sheet_load(const std::string &name, const std::string &file);
@@ -104,8 +146,11 @@ namespace Resources {
     void cleanup();
 }
 
+// Text is drawn from a glyph atlas per font, style and outline
 namespace TextCache {
     void clear();
+    void font_clear(Font *font);
+    void draw(Font *font, int x, int y, const SDL_Color &color, const char *text);
     void size(Font *font, const char *text, int *w, int *h);
 	void size(const char *text, int *w, int *h);
 }
@@ -138,19 +183,99 @@ struct SpriteBufferData {
     }
 };
 
+// Grows by doubling up to sprite_max, anything above that is dropped and counted
+// in overflow_count instead of being written out of bounds.
 struct RenderBuffer {    
     int sprite_count = 0;
-    SpriteBufferData *sprite_data_buffer;
+    int sprite_capacity = 0;
+    int sprite_max = 0;
+    int overflow_count = 0;
+    int culled_count = 0;
+    SpriteBufferData *sprite_data_buffer = NULL;
     
-    void init(size_t sz) {
+    void init(size_t sz, size_t max_sz = 65536) {
+        delete[] sprite_data_buffer;
         sprite_data_buffer = new SpriteBufferData[sz];
+        sprite_capacity = (int)sz;
+        sprite_max = (int)(max_sz > sz ? max_sz : sz);
+        clear();
+    }
+
+    SpriteBufferData *push() {
+        if(sprite_count == sprite_capacity && !grow()) {
+            overflow_count++;
+            return NULL;
+        }
+        return &sprite_data_buffer[sprite_count++];
+    }
+
+    bool grow() {
+        if(sprite_capacity >= sprite_max) {
+            return false;
+        }
+        int new_capacity = sprite_capacity > 0 ? sprite_capacity * 2 : 64;
+        if(new_capacity > sprite_max) {
+            new_capacity = sprite_max;
+        }
+        SpriteBufferData *new_buffer = new SpriteBufferData[new_capacity];
+        std::copy(sprite_data_buffer, sprite_data_buffer + sprite_count, new_buffer);
+        delete[] sprite_data_buffer;
+        sprite_data_buffer = new_buffer;
+        sprite_capacity = new_capacity;
+        return true;
     }
 
     void clear() {
         sprite_count = 0;
+        overflow_count = 0;
+        culled_count = 0;
     }
 };
 
+// Tile map split into TILEMAP_CHUNK_SIZE x TILEMAP_CHUNK_SIZE tile chunks, each baked
+// into a texture once and baked again only after mark_dirty. Only chunks inside the
+// camera view are drawn, so the cost per frame does not depend on the map size.
+// Textures come from a pool big enough to cover the view and are reused by the
+// least recently drawn chunks.
+const unsigned TILEMAP_CHUNK_SIZE = 32;
+
+struct TileMapChunks {
+	const TileMap *tile_map = NULL;
+	const SpriteSheet *sheet = NULL;
+	unsigned chunks_x = 0;
+	unsigned chunks_y = 0;
+	// region of each tile id in the sheet, w is 0 for ids not in the sheet
+	std::vector<SDL_Rect> tile_regions;
+	// per chunk, index into pool or -1
+	std::vector<int> chunk_texture;
+	std::vector<uint8_t> dirty;
+	std::vector<SDL_Texture*> pool;
+	std::vector<int> pool_chunk;
+	std::vector<uint32_t> pool_last_used;
+	uint32_t frame = 0;
+};
+
+void tilemap_chunks_init(TileMapChunks &chunks, const TileMap &t, const SpriteSheet &s);
+// tile coordinates, call after changing a tile with Tiling::tilemap_set
+void tilemap_chunks_mark_dirty(TileMapChunks &chunks, unsigned x, unsigned y);
+void tilemap_chunks_free(TileMapChunks &chunks);
+
+// Texture for content that rarely changes. Draw into it between render_layer_begin
+// and render_layer_end when it is dirty, then draw_render_layer every frame.
+// Create it on the main thread, the texture is not created lazily.
+struct RenderLayer {
+	SDL_Texture *texture = NULL;
+	int w = 0;
+	int h = 0;
+	bool dirty = true;
+};
+
+void render_layer_init(RenderLayer &layer, int w, int h);
+// draw_* calls after this go into the layer, coordinates are relative to its top left
+void render_layer_begin(RenderLayer &layer);
+void render_layer_end(RenderLayer &layer);
+void render_layer_free(RenderLayer &layer);
+
 void window_set_position(int x, int y);
 void window_center();
 void window_set_title(const char* title);
@@ -177,6 +302,9 @@ void draw_text_right_str(int x, int y, const SDL_Color &color, std::string text)
 void draw_text_font_centered(Font *font, int x, int y, const SDL_Color &color, const char *text);
 void draw_text_font_right_aligned(Font *font, int x, int y, const SDL_Color &color, const char *text);
 void draw_tilemap_ortho(const TileMap &t, const SpriteSheet &s, const int x_start, const int y_start);
+// x_start and y_start are in world space, the camera is applied
+void draw_tilemap_chunks(TileMapChunks &chunks, const int x_start, const int y_start);
+void draw_render_layer(const RenderLayer &layer, int x, int y);
 
 void draw_g_pixel(int x, int y);
 void draw_g_pixel_color(int x, int y, const SDL_Color &color);
@@ -199,7 +327,13 @@ void draw_g_rectangle_filled(int x, int y, int w, int h, const SDL_Color &color)
 void draw_g_rectangle_filled_RGBA(int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 void draw_buffer(const RenderBuffer &render_buffer);
 
+// Headless uses the dummy video driver and a software renderer drawing into an
+// offscreen surface, no window is created. Also enabled by SDLECS_HEADLESS=1
+void renderer_set_headless(bool headless);
+bool renderer_is_headless();
 int renderer_init(const char *title, unsigned vw, unsigned vh, unsigned scale);
+// Saves what was last drawn to the screen (after renderer_draw_render_target)
+bool renderer_save_png(const char *filename);
 void renderer_set_clear_color(const SDL_Color &color);
 void renderer_set_color(const SDL_Color &color);
 void renderer_clear();
@@ -208,12 +342,31 @@ void renderer_draw_render_target_camera();
 void renderer_flip();
 void renderer_destroy();
 
+// Pipelined mode, the simulation thread records its draw calls into a frame and
+// renderer_flip hands it over. The main thread replays and presents the newest
+// frame with renderer_pipeline_present. Three frames are kept so recording the
+// next frame overlaps with submitting the previous one.
+// Textures must be loaded before starting (scene initialize), eviction is off while pipelined.
+void renderer_pipeline_start();
+// wakes up both threads, recording stays on until renderer_pipeline_end
+void renderer_pipeline_stop();
+void renderer_pipeline_end();
+bool renderer_pipeline_enabled();
+// when the input for the frame being recorded was sampled, for latency measurements
+void renderer_pipeline_stamp(uint64_t timestamp);
+void renderer_pipeline_publish();
+// returns false if no new frame was published within 100 ms
+bool renderer_pipeline_present(uint64_t *timestamp);
+
 const Camera &get_camera();
+// camera position between the last two updates, use this when drawing
+Vector2 camera_render_position();
 void camera_follow(Vector2 position);
 void camera_lookat(Vector2 position);
 void camera_displace(Vector2 displacement);
 /*! Trauma should be between 0 and 1. */
 void camera_shake(float t);
+// called once per fixed update by the engine
 void camera_update();
 void camera_set_clamp_area(float x_min, float x_max, float y_min, float y_max);
 void camera_reset_clamp_area();
@@ -4,4 +4,5 @@
 #include "particles.cpp"
 #include "renderer.cpp"
 #include "sound.cpp"
-#include "maze.cpp"
\ No newline at end of file
+#include "maze.cpp"
+#include "files.cpp"
\ No newline at end of file
@@ -0,0 +1,337 @@
+#ifndef _BENCHMARKS_H
+#define _BENCHMARKS_H
+
+#include "engine.h"
+#include "renderer.h"
+#include "battle_controller.h"
+#include "unit_creator.h"
+#include "display_export.h"
+#include "particles.h"
+#include "maze.h"
+#include "map_chunks.h"
+
+#include <chrono>
+#include <random>
+
+// Run with: main.exe --bench [--headless] [--dump <folder>]
+// Scenes are loaded (game_load) before these run so sheets and configs are available
+
+typedef std::chrono::high_resolution_clock BenchClock;
+
+static double bench_elapsed_us(BenchClock::time_point start) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count() / 1000.0;
+}
+
+void benchmark_render_export(int sprite_count, int iterations) {
+    Engine::logn("[BENCH] render export, %d sprites, %d iterations", sprite_count, iterations);
+
+    ECS::EntityManager entity_manager;
+    RenderBuffer render_buffer;
+    render_buffer.init(2048);
+
+    // all inside the view so nothing is culled, worst case for extraction
+    BattleController::_projectiles.clear();
+    BattleController::_projectiles.reserve(sprite_count);
+    for(int i = 0; i < sprite_count; i++) {
+        ProjectileSpawn spawn;
+        spawn.faction = PLAYER_FACTION;
+        spawn.position = Vector2(RNG::range_f(0, (float)gw), RNG::range_f(0, (float)gh));
+        spawn.target_position = Vector2(RNG::range_f(0, (float)gw), RNG::range_f(0, (float)gh));
+        spawn.projectile_speed = 0;
+        spawn.projectile_speed_increase = 0;
+        spawn.projectile_speed_max = 0;
+        spawn.projectile_type = ProjectileType::LazerBulletRed;
+        UnitCreator::create_projectile(spawn, entity_manager, BattleController::_projectiles);
+    }
+
+    // warm up so buffers have grown and caches are hot
+    render_export(render_buffer, 1.0f);
+
+    double min_us = 1e12, max_us = 0, total_us = 0;
+    for(int i = 0; i < iterations; i++) {
+        auto start = BenchClock::now();
+        render_export(render_buffer, 1.0f);
+        double us = bench_elapsed_us(start);
+        min_us = us < min_us ? us : min_us;
+        max_us = us > max_us ? us : max_us;
+        total_us += us;
+    }
+
+    Engine::logn("[BENCH] render export: exported %d, culled %d", render_buffer.sprite_count, render_buffer.culled_count);
+    Engine::logn("[BENCH] render export: min %.1f us, mean %.1f us, max %.1f us", min_us, total_us / iterations, max_us);
+
+    BattleController::_projectiles.clear();
+}
+
+// Draws a fixed scene of sprites, particles, primitives and text every frame.
+// Everything is seeded and stepped with a fixed dt so dumped frames can be
+// compared against golden images, run --headless for the software renderer.
+void benchmark_render(int frames, const char *dump_folder) {
+    Engine::logn("[BENCH] render, %d frames%s", frames, renderer_is_headless() ? " (headless)" : "");
+
+    std::mt19937 g(1234);
+    const float dt = 1.0f / 60.0f;
+
+    const auto &sheet = Resources::sprite_sheet_get("combat_sprites");
+    SDL_Texture *texture = Resources::sprite_get(sheet.sprite_sheet_name)->image;
+    RenderBuffer render_buffer;
+    render_buffer.init(2048);
+    for(int i = 0; i < 2000; i++) {
+        SpriteBufferData *spr = render_buffer.push();
+        const auto &frame = sheet.sheet_sprites[RNG::range_i(0, (int)sheet.sheet_sprites.size() - 1, g)];
+        spr->tex = texture;
+        spr->src = frame.region;
+        spr->dest = { RNG::range_i(0, (int)gw, g), RNG::range_i(0, (int)gh, g), frame.region.w, frame.region.h };
+        spr->angle = RNG::range_f(0, 360, g);
+        spr->layer = RNG::range_i(0, 3, g);
+    }
+    std::sort(render_buffer.sprite_data_buffer, render_buffer.sprite_data_buffer + render_buffer.sprite_count);
+
+    Particles::ParticleContainer particles = Particles::make(2048);
+    for(int i = 0; i < 2000; i++) {
+        Vector2 position = Vector2(RNG::range_f(0, (float)gw, g), RNG::range_f(0, (float)gh, g));
+        Particles::spawn(particles, position, 100.0f, RNG::range_f(0, 360, g), RNG::range_f(5, 30, g),
+            RNG::range_f(1, 4, g), RNG::range_f(1, 4, g), Vector2(0, 0), Colors::yellow, Colors::red);
+    }
+
+    // frame log changes every frame which would break the golden images
+    const Point log_position = FrameLog::get_position();
+    const bool log_enabled = FrameLog::is_enabled();
+    FrameLog::disable();
+
+    char label[32];
+    double min_us = 1e12, max_us = 0, total_us = 0;
+    for(int frame = 0; frame < frames; frame++) {
+        auto start = BenchClock::now();
+
+        Particles::update(particles, dt);
+
+        renderer_clear();
+        draw_buffer(render_buffer);
+        Particles::render_circles_filled(particles);
+        for(int i = 0; i < 100; i++) {
+            int x = (i * 37) % gw;
+            int y = (i * 53) % gh;
+            draw_g_rectangle_RGBA(x, y, 20, 12, 82, 201, 90, 255);
+            draw_g_rectangle_filled_RGBA(x + 4, y + 4, 12, 4, 201, 82, 82, 255);
+            draw_g_line_RGBA(x, y, x + 30, y + 20, 82, 82, 201, 255);
+            draw_g_circle_RGBA(x, y, 6, 255, 255, 255, 255);
+        }
+        for(int i = 0; i < 200; i++) {
+            snprintf(label, sizeof(label), "%d/%d", (frame + i) % 100, i);
+            draw_text((i * 29) % gw, (i * 17) % gh, Colors::white, label);
+        }
+        renderer_draw_render_target();
+        renderer_flip();
+
+        double us = bench_elapsed_us(start);
+        min_us = us < min_us ? us : min_us;
+        max_us = us > max_us ? us : max_us;
+        total_us += us;
+
+        if(dump_folder != NULL && frame % 60 == 0) {
+            renderer_save_png(Text::format("%s/render_%04d.png", dump_folder, frame).c_str());
+        }
+    }
+
+    Engine::logn("[BENCH] render: min %.1f us, mean %.1f us, max %.1f us", min_us, total_us / frames, max_us);
+
+    if(log_enabled) {
+        FrameLog::enable_at(log_position.x, log_position.y);
+    }
+    delete[] particles.particles;
+}
+
+void benchmark_maze_generate(int size, int chunk_size, MazeSelection selection, const char *name) {
+    Maze maze;
+    maze_generate(maze, size, size);
+    MazeGrowSettings settings;
+    settings.seed = 1234;
+    settings.selection = selection;
+    settings.chunk_size = chunk_size;
+
+    double min_us = 1e12, max_us = 0;
+    for(int i = 0; i < 3; i++) {
+        auto start = BenchClock::now();
+        maze_grow_tree(&maze, settings);
+        double us = bench_elapsed_us(start);
+        min_us = us < min_us ? us : min_us;
+        max_us = us > max_us ? us : max_us;
+    }
+
+    // a perfect maze has exactly one connection less than it has cells
+    size_t connections = 0;
+    for(int y = 0; y < size; y++) {
+        for(int x = 0; x < size; x++) {
+            connections += maze.is_open(x, y, Directions::East) + maze.is_open(x, y, Directions::South);
+        }
+    }
+    Engine::logn("[BENCH] maze %dx%d %s, chunk %d: min %.1f ms, max %.1f ms, %s", size, size, name, chunk_size, 
+        min_us / 1000.0, max_us / 1000.0, connections == (size_t)size * size - 1 ? "ok" : "NOT A TREE");
+    maze_free(&maze);
+}
+
+// Flies across the unbounded map in a straight line, the cache should stay the
+// same size and the workers should have most chunks ready before they are needed
+void benchmark_map_streaming(int steps, int cells_per_step) {
+    MapChunkCache cache;
+    cache.init(1234, 256 * 1024);
+    const int view_w = gw / 128 + 3;
+    const int view_h = gh / 128 + 3;
+    const Vector2 velocity((float)cells_per_step, 0.0f);
+
+    double max_us = 0, total_us = 0;
+    for(int i = 0; i < steps; i++) {
+        auto start = BenchClock::now();
+        Rectangle view(i * cells_per_step, 0, view_w, view_h);
+        cache.frame_begin();
+        cache.prefetch(view, velocity);
+        for(int y = view.y; y < view.y + view.h; y++) {
+            for(int x = view.x; x < view.x + view.w; x += MAP_CHUNK_SIZE) {
+                cache.require(MapChunkCache::chunk_of(x), MapChunkCache::chunk_of(y));
+            }
+            cache.require(MapChunkCache::chunk_of(view.x + view.w - 1), MapChunkCache::chunk_of(y));
+        }
+        double us = bench_elapsed_us(start);
+        max_us = us > max_us ? us : max_us;
+        total_us += us;
+        // about a frame, gives the workers time like the game would
+        SDL_Delay(1);
+    }
+    Jobs::wait_idle();
+
+    Engine::logn("[BENCH] map streaming, %d steps of %d cells: mean %.1f us, max %.1f us", steps, cells_per_step, total_us / steps, max_us);
+    Engine::logn("[BENCH] map streaming: %d kb for %d chunks, generated %u (%u while waiting), evicted %u, dropped %u", 
+        (int)(cache.memory_used() / 1024), cache.capacity, cache.stats.generated, cache.stats.generated_waiting, cache.stats.evictions, cache.stats.dropped);
+    cache.free();
+}
+
+// Batch noise against one sample at a time, the values have to be the same
+void benchmark_noise_grid(Noise::Type type, const char *name) {
+    Noise::set_seed(1234);
+    Noise::Grid settings;
+    settings.type = type;
+    settings.x = -1000.0f;
+    settings.y = -500.0f;
+    settings.step = 0.75f;
+    settings.width = 1024;
+    settings.height = 1024;
+    settings.octaves = 4;
+    std::vector<float> scalar(settings.width * settings.height);
+    std::vector<float> batch(scalar.size());
+
+    auto start = BenchClock::now();
+    Noise::grid_scalar(settings, scalar.data());
+    double scalar_us = bench_elapsed_us(start);
+
+    start = BenchClock::now();
+    Noise::grid(settings, batch.data());
+    double batch_us = bench_elapsed_us(start);
+
+    settings.threaded = true;
+    start = BenchClock::now();
+    Noise::grid(settings, batch.data());
+    double threaded_us = bench_elapsed_us(start);
+
+    float max_difference = 0;
+    for(size_t i = 0; i < scalar.size(); i++) {
+        max_difference = Math::max_f(max_difference, std::abs(scalar[i] - batch[i]));
+    }
+    Engine::logn("[BENCH] noise %s %dx%d: scalar %.1f ms, sse2 %.1f ms, threaded %.1f ms (%d workers), max difference %g", name,
+        settings.width, settings.height, scalar_us / 1000.0, batch_us / 1000.0, threaded_us / 1000.0, Jobs::thread_count(), max_difference);
+}
+
+// Counts what tick allocates after a warm up tick, the profiler zones say where.
+// With must_be_zero any allocation fails the run, a regression gate for paths
+// that should not allocate once they are warmed up.
+template<typename Tick>
+int benchmark_allocations(const char *name, int ticks, bool must_be_zero, Tick tick) {
+    const bool tracking = Allocations::is_enabled();
+    const bool profiling = Profiler::is_enabled();
+    Profiler::set_enabled(true);
+    tick();
+
+    Allocations::set_enabled(true);
+    Allocations::reset();
+    for(int i = 0; i < ticks; i++) {
+        tick();
+    }
+    Allocations::set_enabled(tracking);
+    const Allocations::Counts total = Allocations::total();
+    Allocations::LabelCounts top[4];
+    const int label_count = Allocations::labels(top, 4);
+    Profiler::set_enabled(profiling);
+    Profiler::frame();
+
+    Engine::logn("[BENCH] allocations %s: %.1f per tick, %.0f bytes per tick", name, (double)total.count / ticks, (double)total.bytes / ticks);
+    for(int i = 0; i < label_count; i++) {
+        Engine::logn("[BENCH]   %s: %.1f per tick", top[i].name, (double)top[i].counts.count / ticks);
+    }
+    if(must_be_zero && total.count > 0) {
+        Engine::logn("[BENCH] FAIL %s allocates in steady state", name);
+        return 1;
+    }
+    return 0;
+}
+
+int benchmark_allocation_gates() {
+    ECS::EntityManager entity_manager;
+    RenderBuffer render_buffer;
+    render_buffer.init(2048);
+    BattleController::_projectiles.clear();
+    for(int i = 0; i < 500; i++) {
+        ProjectileSpawn spawn;
+        spawn.faction = PLAYER_FACTION;
+        spawn.position = Vector2(RNG::range_f(0, (float)gw), RNG::range_f(0, (float)gh));
+        spawn.target_position = Vector2(RNG::range_f(0, (float)gw), RNG::range_f(0, (float)gh));
+        spawn.projectile_speed = 0;
+        spawn.projectile_speed_increase = 0;
+        spawn.projectile_speed_max = 0;
+        spawn.projectile_type = ProjectileType::LazerBulletRed;
+        UnitCreator::create_projectile(spawn, entity_manager, BattleController::_projectiles);
+    }
+    Particles::ParticleContainer particles = Particles::make(2048);
+    for(int i = 0; i < 2000; i++) {
+        Vector2 position = Vector2(RNG::range_f(0, (float)gw), RNG::range_f(0, (float)gh));
+        Particles::spawn(particles, position, 100.0f, RNG::range_f(0, 360), 1000.0f, 2.0f, 2.0f, Vector2(0, 0), Colors::yellow, Colors::red);
+    }
+
+    int failures = 0;
+    failures += benchmark_allocations("render export", 100, true, [&]() { 
+        render_export(render_buffer, 1.0f); 
+    });
+    failures += benchmark_allocations("particles", 100, true, [&]() { 
+        Particles::update(particles, 1.0f / 60.0f); 
+    });
+    failures += benchmark_allocations("draw", 100, true, [&]() {
+        renderer_clear();
+        draw_buffer(render_buffer);
+        Particles::render_circles_filled(particles);
+        renderer_draw_render_target();
+        renderer_flip();
+    });
+    // not a gate yet, immediate ui elements are still made with make_shared
+    benchmark_allocations("ui export", 100, false, []() { 
+        ui_export(); 
+    });
+
+    BattleController::_projectiles.clear();
+    delete[] particles.particles;
+    return failures;
+}
+
+int run_benchmarks(const char *dump_folder) {
+    benchmark_render_export(5000, 500);
+    benchmark_maze_generate(4096, 64, MazeSelection::Newest, "newest");
+    benchmark_maze_generate(4096, 64, MazeSelection::Random, "random");
+    benchmark_maze_generate(4096, 64, MazeSelection::Mixed, "mixed");
+    benchmark_maze_generate(4096, 0, MazeSelection::Random, "random");
+    benchmark_map_streaming(2000, 2);
+    benchmark_noise_grid(Noise::Perlin, "perlin");
+    benchmark_noise_grid(Noise::Simplex, "simplex");
+    benchmark_noise_grid(Noise::SimplexFractal, "simplex fractal");
+    benchmark_render(300, dump_folder);
+    return benchmark_allocation_gates();
+}
+
+#endif
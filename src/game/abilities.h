@@ -284,7 +284,7 @@ struct AbilityComponent {
     }
 
     void use(int faction, Vector2 position, std::vector<ProjectileSpawn> &projectile_spawns, std::vector<Effect> &effects, std::vector<ECS::EntityId> &target_override) {
-        Engine::logn("Ability use: %s - %d", ability.name.c_str(), faction);
+        LOG_DEBUG(Log::Battle, "Ability use: %s - %d", ability.name.c_str(), faction);
 
         Effect e = Effect(ability.faction, ability.faction, 0.5f, 6.0f, 6);
         
@@ -461,7 +461,7 @@ struct DefenseComponent {
     }
     
     void apply(const Effect &e) {
-        Engine::logn("Apply effect! = %d", e.shield_recharge_amount);
+        LOG_DEBUG(Log::Battle, "Apply effect! = %d", e.shield_recharge_amount);
         shield = Math::clamp_i(shield + e.shield_recharge_amount, 0, shield_max);
     }
 
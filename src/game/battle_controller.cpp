@@ -128,6 +128,7 @@ namespace BattleController {
         particles = Particles::make(4096);
         particle_emitters_configure(&particle_config);
         UnitCreator::init_targeters(get_one_target);
+        UnitCreator::build_prefabs();
         // Services::events().listen<EntityDestroyedEvent>(&entity_destroyed);
     }
 
@@ -168,8 +169,7 @@ namespace BattleController {
         float y_start = 50;
         int i = 9000;
         int column = 0;
-        auto fighter_cfg = Services::db()->get_fighter_config(f.id);
-        switch(fighter_cfg.type) {
+        switch(Services::db()->get_fighter_type(f.id)) {
             case FighterType::Interceptor: {
                 position.x = faction == PLAYER_FACTION ? 280.0f : 360.0f;
                 i = std::count_if(_fighter_ships.begin(), _fighter_ships.end(), [=](FighterShip &ship) {
@@ -222,12 +222,12 @@ namespace BattleController {
     void spawn_of_type(int count, FighterType fighter_type, std::vector<FighterData> &fighters, int fighters_max, int faction) {
         for(int i = 0; i < count; i++) {
             for(auto &f : fighters) {
-                auto fighter = Services::db()->get_fighter_config(f.id);
+                auto &fighter = Services::db()->get_fighter_stats(f.id);
                 if(fighter.type == fighter_type) {
                     int &energy = faction == PLAYER_FACTION ? player_energy_system.current : fleet_ai.energy_system.current;
                     int energy_cost = fighter.energy_cost;
                     if(energy < energy_cost) {
-                        Engine::logn("Not enough energy");
+                        LOG_DEBUG(Log::Battle, "Not enough energy");
                         return;
                     }
 
@@ -241,8 +241,8 @@ namespace BattleController {
     }
 
     void spawn_enemies() {
-        auto fighter = Services::db()->get_fighter_config(fleet_ai.fleet.fighters[0].id);
-        spawn_of_type(fleet_ai.spawn_count, fighter.type, fleet_ai.fleet.fighters, fleet_ai.fleet.max_count, ENEMY_FACTION);
+        auto fighter_type = Services::db()->get_fighter_type(fleet_ai.fleet.fighters[0].id);
+        spawn_of_type(fleet_ai.spawn_count, fighter_type, fleet_ai.fleet.fighters, fleet_ai.fleet.max_count, ENEMY_FACTION);
         
         // spawn_fighter(enemy_fleet.fighters[0], enemy_fleet.max_count, ENEMY_FACTION);
 
@@ -342,6 +342,7 @@ namespace BattleController {
     
     template<typename Entity>
     void system_abilities(Entity &entities) {
+        PROFILE_SCOPE("abilities");
         for (auto &entity : entities) {
             entity.abilities.update_timer(Time::delta_time);
             
@@ -364,6 +365,7 @@ namespace BattleController {
 
     template<typename Entity>
     void system_destroy_explode_entities(Entity &entities) {
+        PROFILE_SCOPE("destroy explode entities");
         for(auto &entity : entities) {
             if(entity.defense.hp <= 0) {
                 particle_config.explosion_emitter.position = entity.position.value;
@@ -375,6 +377,7 @@ namespace BattleController {
 
     template<typename EntityVector>
     void system_update_columns(EntityVector& entities) {
+        PROFILE_SCOPE("update columns");
         for(auto &e : entities) {
             if(e.life_time.marked_for_deletion) { 
                 toggle_column_position(e.type, e.faction.faction, e.column_position);
@@ -397,13 +400,14 @@ namespace BattleController {
         
         particle_config.smoke_emitter.position = ship.position.value;
         Particles::emit(particles, particle_config.smoke_emitter);
-        ship.sprite.set_current_animation("hit", "idle");
+        ship.sprite.set_current_animation(ANIMATION_HIT, ANIMATION_IDLE);
         //fighter->sprite.set_current_animation("hit");
         //SpriteAnimation::set_current(fighter->animation, "hit");
     }
 
     template<typename First, typename Second>
     void system_collision_resolution(CollisionPairs &collision_pairs, std::vector<First> &entity_first, std::vector<Second> &entity_second) {
+        PROFILE_SCOPE("collision resolution");
         collision_pairs.sort_by_distance();
         // This set will contain all collisions that we have handled
         // Since first in this instance is projectile and the list is sorted by distance
@@ -431,6 +435,7 @@ namespace BattleController {
 
     template<typename First, typename Second>
     void system_effects(First &first, Second &second) {
+        PROFILE_SCOPE("effects");
         for(auto &effect : _effects) {
             effect.tick_timer += Time::delta_time;
             effect.ttl_timer += Time::delta_time;
@@ -452,7 +457,7 @@ namespace BattleController {
 
                     int energy_before = energy;
                     energy -= effect.tick_energy_cost;
-                    Engine::logn("before: %d, after: %d", energy_before, energy);
+                    LOG_DEBUG(Log::Battle, "before: %d, after: %d", energy_before, energy);
                 }
 
                 effect.tick_timer = 0.0f;
@@ -461,6 +466,7 @@ namespace BattleController {
     }
 
     void system_energy_recharge(EnergySystem &e, const float dt) {
+        PROFILE_SCOPE("energy recharge");
         e.recharge_timer += dt;
         if(e.recharge_timer >= e.recharge_rate) {
             e.current = Math::clamp_i(e.current + e.recharge_amount, 0, e.max);
@@ -469,6 +475,7 @@ namespace BattleController {
     }
     
     void update() {
+        PROFILE_SCOPE("battle update");
         Particles::update(particles, Time::delta_time);
 
         system_abilities(_motherships);
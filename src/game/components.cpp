@@ -0,0 +1,54 @@
+#include "components.h"
+
+namespace Animations {
+    std::vector<AnimationClip> _clips;
+    std::vector<uint8_t> _group_counts;
+    std::unordered_map<std::string, AnimationId> _groups_by_identifier;
+
+    AnimationId add(const std::string &identifier, const std::vector<AnimationClip> &clips) {
+        auto existing = _groups_by_identifier.find(identifier);
+        if(existing != _groups_by_identifier.end()) {
+            return existing->second;
+        }
+
+        ASSERT_WITH_MSG(clips.size() > 0 && clips.size() < 0xFF, "Animations::add, invalid clip count");
+        ASSERT_WITH_MSG(_clips.size() + clips.size() < NONE, "Animations::add, too many clips");
+
+        AnimationId first = (AnimationId)_clips.size();
+        for(auto &clip : clips) {
+            _clips.push_back(clip);
+            _group_counts.push_back(0);
+        }
+        _group_counts[first] = (uint8_t)clips.size();
+        _groups_by_identifier[identifier] = first;
+        return first;
+    }
+
+    AnimationId add_sprite(const std::string &sprite_sheet_name, const std::string &sprite_name) {
+        std::string identifier = sprite_sheet_name + ":" + sprite_name;
+        auto existing = _groups_by_identifier.find(identifier);
+        if(existing != _groups_by_identifier.end()) {
+            return existing->second;
+        }
+        return add(identifier, { AnimationClip({ { sprite_sheet_name, sprite_name } }, 0, false) });
+    }
+
+    AnimationId find(const std::string &identifier) {
+        auto existing = _groups_by_identifier.find(identifier);
+        return existing != _groups_by_identifier.end() ? existing->second : NONE;
+    }
+
+    const AnimationClip &get(const AnimationId id) {
+        return _clips[id];
+    }
+
+    uint8_t count(const AnimationId id) {
+        return _group_counts[id];
+    }
+
+    void clear() {
+        _clips.clear();
+        _group_counts.clear();
+        _groups_by_identifier.clear();
+    }
+}
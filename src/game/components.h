@@ -37,7 +37,10 @@ struct LifeTime {
     LifeTime() {}
 };
 
+// texture and region are resolved once here so render export never has to look them up
 struct AnimationFrame {
+    SDL_Texture *texture = NULL;
+    SDL_Rect region;
     int w, h;
     int16_t radius;
     int16_t color_r;
@@ -51,65 +54,56 @@ struct AnimationFrame {
 
     AnimationFrame(const std::string &sprite_sheet_name, const std::string &sprite_name) : sprite_name(sprite_name) {
         sprite_sheet_index = Resources::sprite_sheet_index(sprite_sheet_name);
-        auto sprite = Resources::sprite_get_from_sheet(sprite_sheet_index, sprite_name);
-        w = sprite.w;
-        h = sprite.h;
+        region = Resources::sprite_get_from_sheet(sprite_sheet_index, sprite_name);
+        texture = Resources::sprite_get(Resources::get_sprite_sheets()[sprite_sheet_index].sprite_sheet_name)->image;
+        w = region.w;
+        h = region.h;
         color_r = color_g = color_b = color_a = 255;
     }
 };
 
-struct Animation {
-    std::string _identifier;
-	size_t _frame = 0;
-	float _timer = 0;
-	float _fps = 3;
-	float _duration = 1;
-	bool _loop = false;
-    bool _completed = false;
-
-    std::vector<AnimationFrame> _frames;
+// Immutable clip definition, registered once in the animation library and shared by id
+struct AnimationClip {
+	float duration = 1;
+	bool loop = false;
+    std::vector<AnimationFrame> frames;
 
-    Animation(const std::string &identifier, const std::vector<AnimationFrame> &frames, const float fps, const bool loop) {
-        _identifier = identifier;
-        _fps = fps;
+    AnimationClip(const std::vector<AnimationFrame> &frames, const float fps, const bool loop) : loop(loop), frames(frames) {
         if(fps > 0) {
-            _duration = 1.0f / fps;
+            duration = 1.0f / fps;
         }
-        _loop = loop;
-        _frames = frames;
-
-        restart();
     }
+};
 
-    void restart() {
-        _frame = 0;
-        _timer = 0.0f;
-        _completed = false;
-    }
+typedef uint16_t AnimationId;
 
-    void update(float dt) {
-        _timer += dt;
-		if(_timer >= _duration) {
-			_frame++;
-			if(_frame >= _frames.size()) {
-				if(_loop) {
-					_frame = 0;
-				} else {
-                    _completed = true;
-					_frame = _frames.size() - 1;
-				}
-			}
-			_timer = 0;
-		}
-    }
-};
+// Clips are registered in groups (e.g. idle and hit for a ship) under one identifier.
+// Sprite components keep the id of the first clip and index into the group.
+namespace Animations {
+    const AnimationId NONE = 0xFFFF;
+
+    // Registering an identifier that already exists returns the existing group
+    AnimationId add(const std::string &identifier, const std::vector<AnimationClip> &clips);
+    // Single frame, non looping group for a sprite in a sheet
+    AnimationId add_sprite(const std::string &sprite_sheet_name, const std::string &sprite_name);
+    AnimationId find(const std::string &identifier);
+    const AnimationClip &get(const AnimationId id);
+    uint8_t count(const AnimationId id);
+    void clear();
+}
+
+// Index of clips in a ship animation group
+const uint8_t ANIMATION_IDLE = 0;
+const uint8_t ANIMATION_HIT = 1;
 
 struct SpriteComponent {
     private:
-    std::vector<Animation> animations;
-    size_t current_animation = 0;
-
-    int _next_animation = -1;
+    AnimationId _animations = Animations::NONE;
+    uint8_t _current = 0;
+    uint8_t _next = 0xFF;
+    uint16_t _frame = 0;
+    bool _completed = false;
+    float _timer = 0;
 
     public:
     int layer = 0;
@@ -123,48 +117,49 @@ struct SpriteComponent {
 
     SpriteComponent() {}
 
-    SpriteComponent(const std::string &sprite_sheet_name, std::string sprite_name) {
-        animations.push_back(Animation("_____DEFAULT_____", { { sprite_sheet_name, sprite_name } }, 0, false));
-    }
-
-    SpriteComponent(const std::vector<Animation> anims) {
-        animations = anims;
-    }
+    SpriteComponent(const AnimationId animations) : _animations(animations) {}
 
     const AnimationFrame &get_current_frame() const {
-        auto &animation = animations[current_animation];
-        return animation._frames[animation._frame];
+        return Animations::get(_animations + _current).frames[_frame];
     }
 
-    void set_current_animation(std::string animation) {
-        if(animations[current_animation]._identifier == animation) {
+    void set_current_animation(const uint8_t animation) {
+        if(_current == animation || animation >= Animations::count(_animations)) {
             return;
         }
-
-        for(size_t i = 0; i < animations.size(); i++) {
-            if(animations[i]._identifier == animation) {
-                animations[i].restart();
-                current_animation = i;
-                return;
-            }
-        }
+        _current = animation;
+        _frame = 0;
+        _timer = 0.0f;
+        _completed = false;
     }
 
-    void set_current_animation(std::string animation, std::string next_animation) {
+    void set_current_animation(const uint8_t animation, const uint8_t next_animation) {
         set_current_animation(animation);
-        for(size_t i = 0; i < animations.size(); i++) {
-            if(animations[i]._identifier == next_animation) {
-                _next_animation = i;
-            }
-        }
+        _next = next_animation;
     }
 
     void update_animation(float dt) {
-        auto &animation = animations[current_animation];
-		animation.update(dt);
-        if(animation._completed && _next_animation >= 0) {
-            set_current_animation(animations[_next_animation]._identifier);
-            _next_animation = -1;
+        if(!_completed) {
+            const AnimationClip &clip = Animations::get(_animations + _current);
+            _timer += dt;
+            if(_timer >= clip.duration) {
+                _frame++;
+                if(_frame >= clip.frames.size()) {
+                    if(clip.loop) {
+                        _frame = 0;
+                    } else {
+                        _completed = true;
+                        _frame = (uint16_t)(clip.frames.size() - 1);
+                    }
+                }
+                _timer = 0;
+            }
+        }
+
+        if(_completed && _next != 0xFF) {
+            uint8_t next = _next;
+            _next = 0xFF;
+            set_current_animation(next);
         }
     }
 };
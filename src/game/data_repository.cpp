@@ -1,198 +1,658 @@
 #include "data_repository.h"
+#include "files.h"
 #include <fstream>
+#include <cmath>
+#include <cstring>
+#include <climits>
 
+// Tables, weapons are indexed by WeaponId
 std::vector<FighterConfig> _fighters;
+std::vector<FighterStats> _fighter_stats;
+std::vector<int> _fighter_index_by_id;
 std::vector<Weapon> _weapons;
+// ids in between are unused slots, only these are real weapons
+std::vector<bool> _weapon_defined;
 
-void load_weapons() {
-    std::string file = "weapons.data";
-    std::string file_name = Engine::get_base_data_folder() + file;
-    std::ifstream weapon_data(file_name);
+static const char *DB_BINARY_FILE = "db.bin";
+static const char *WEAPONS_FILE = "weapons.data";
+static const char *FIGHTERS_FILE = "fighter.data";
 
-    if (!weapon_data.is_open()) {
-        Engine::logn("ERROR: No data in weapons.data");
-        Engine::exit();
-        return;
+// Compiled form of the .data files, all fields are 4 bytes so there is no padding.
+// Layout: header | weapons | fighters | fighter weapons | strings
+namespace DataBinary {
+    const uint32_t MAGIC = 0x31424453; // SDB1
+    const uint32_t VERSION = 1;
+    // ids index the tables, anything above this is a broken file
+    const int32_t MAX_ID = 0xffff;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t weapon_count;
+        uint32_t fighter_count;
+        uint32_t fighter_weapon_count;
+        uint32_t string_size;
+    };
+
+    struct WeaponRecord {
+        int32_t id;
+        uint32_t name;
+        float reload_time;
+        int32_t damage;
+        float accuracy;
+        int32_t projectile_type;
+        int32_t projectile_count;
+        float burst_delay;
+        int32_t radius;
+        float projectile_speed;
+        float projectile_speed_increase;
+        float projectile_speed_max;
+    };
+
+    struct FighterRecord {
+        int32_t id;
+        uint32_t name;
+        uint32_t sprite_base;
+        int32_t type;
+        int32_t cost_resource;
+        int32_t cost_population;
+        int32_t energy_cost;
+        int32_t hp;
+        int32_t shield;
+        uint32_t weapon_first;
+        uint32_t weapon_count;
+    };
+
+    struct FighterWeaponRecord {
+        int32_t weapon_id;
+        int32_t targeting;
+    };
+}
+
+struct EnumName {
+    const char *name;
+    int value;
+};
+
+static const EnumName projectile_type_names[] = {
+    { "ProjectileType::Bullet", ProjectileType::Bullet },
+    { "ProjectileType::LazerBeamGreen", ProjectileType::LazerBeamGreen },
+    { "ProjectileType::LazerBulletRed", ProjectileType::LazerBulletRed },
+    { "ProjectileType::LazerBulletRedLarge", ProjectileType::LazerBulletRedLarge },
+    { "ProjectileType::Missile", ProjectileType::Missile },
+    { "ProjectileType::SmallBullet", ProjectileType::SmallBullet }
+};
+
+static const EnumName fighter_type_names[] = {
+    { "FighterType::Interceptor", FighterType::Interceptor },
+    { "FighterType::Cruiser", FighterType::Cruiser },
+    { "FighterType::Destroyer", FighterType::Destroyer }
+};
+
+static bool parse_int(const char *begin, const char *end, int &value) {
+    const char *p = begin;
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
     }
-    
-    if(weapon_data) {
-        std::map<std::string, ProjectileType> proj = {
-            {  "ProjectileType::Bullet", ProjectileType::Bullet } ,
-            {  "ProjectileType::LazerBeamGreen", ProjectileType::LazerBeamGreen } ,
-            {  "ProjectileType::LazerBulletRed", ProjectileType::LazerBulletRed } ,
-            {  "ProjectileType::LazerBulletRedLarge", ProjectileType::LazerBulletRedLarge } ,
-            {  "ProjectileType::Missile", ProjectileType::Missile } ,
-            {  "ProjectileType::SmallBullet", ProjectileType::SmallBullet } 
-        };
-        
-        
-        std::string line;
-        std::getline(weapon_data, line); // ignore header
-        while (std::getline(weapon_data, line)) {
-            Weapon w;
-            std::istringstream data(line);
-            std::string value;
-            std::getline(data, w.name, '|');
-            std::getline(data, value, '|');
-            w.reload_time = std::stof(value);
-            std::getline(data, value, '|');
-            w.damage = std::stoi(value);
-            std::getline(data, value, '|');
-            w.accuracy = std::stof(value);
-            
-            std::getline(data, value, '|');
-            w.projectile_type = proj[value];
-
-            std::getline(data, value, '|');
-            w.projectile_count = std::stoi(value);
-
-            std::getline(data, value, '|');
-            w.burst_delay = std::stof(value);
-
-            std::getline(data, value, '|');
-            w.radius = std::stoi(value);
-
-            std::getline(data, value, '|');
-            w.projectile_speed = std::stof(value);
-
-            std::getline(data, value, '|');
-            w.projectile_speed_increase = std::stof(value);
-            std::getline(data, value, '|');
-            w.projectile_speed_max = std::stof(value);
-
-            _weapons.push_back(w);
+    if(p == end) {
+        return false;
+    }
+    int result = 0;
+    for(; p < end; p++) {
+        if(*p < '0' || *p > '9') {
+            return false;
         }
-    } else {
-        Engine::log("\n[WARNING] unable to open weapons file");
-    } 
+        const int digit = *p - '0';
+        if(result > (INT_MAX - digit) / 10) {
+            // too many digits, would overflow
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+static bool parse_float(const char *begin, const char *end, float &value) {
+    const char *p = begin;
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    double result = 0.0;
+    int digits = 0;
+    for(; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        result = result * 10.0 + (*p - '0');
+    }
+    if(p < end && *p == '.') {
+        double scale = 0.1;
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            result += (*p - '0') * scale;
+            scale *= 0.1;
+        }
+    }
+    if(digits == 0) {
+        return false;
+    }
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        int exponent;
+        if(!parse_int(p + 1, end, exponent)) {
+            return false;
+        }
+        result *= std::pow(10.0, exponent);
+        p = end;
+    }
+    if(p != end) {
+        return false;
+    }
+    value = (float)(negative ? -result : result);
+    return true;
+}
+
+// Tokenizes a mapped .data file in place. One record per line, fields separated by '|'.
+// Errors are logged as file:line:column and the parse is marked as failed.
+struct DataParser {
+    const char *file_name;
+    const char *next;
+    const char *end;
+    const char *line_start = NULL;
+    const char *line_end = NULL;
+    const char *cursor = NULL;
+    int line = 0;
+    bool failed = false;
+
+    DataParser(const char *file_name, const MappedFile &file) : file_name(file_name), next(file.data), end(file.data + file.size) {}
+
+    // Moves to the next non empty line, false at end of file or after an error
+    bool next_line() {
+        while(!failed && next < end) {
+            line++;
+            line_start = next;
+            const char *p = next;
+            while(p < end && *p != '\n') {
+                p++;
+            }
+            next = p < end ? p + 1 : end;
+            line_end = p;
+            if(line_end > line_start && line_end[-1] == '\r') {
+                line_end--;
+            }
+            if(line_end > line_start) {
+                cursor = line_start;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void error(const char *at, const char *message) {
+        if(!failed) {
+            Engine::logn("[DB] %s:%d:%d: %s", file_name, line, (int)(at - line_start) + 1, message);
+        }
+        failed = true;
+    }
+
+    bool field(const char *&begin, const char *&field_end) {
+        if(failed) {
+            return false;
+        }
+        if(cursor > line_end) {
+            error(line_end, "missing field");
+            return false;
+        }
+        begin = cursor;
+        const char *p = cursor;
+        while(p < line_end && *p != '|') {
+            p++;
+        }
+        field_end = p;
+        cursor = p + 1;
+        return true;
+    }
+
+    void read_int(int &value) {
+        const char *begin, *field_end;
+        if(field(begin, field_end) && !parse_int(begin, field_end, value)) {
+            error(begin, "expected integer");
+        }
+    }
+
+    void read_float(float &value) {
+        const char *begin, *field_end;
+        if(field(begin, field_end) && !parse_float(begin, field_end, value)) {
+            error(begin, "expected number");
+        }
+    }
+
+    void read_string(std::string &value) {
+        const char *begin, *field_end;
+        if(field(begin, field_end)) {
+            value.assign(begin, field_end);
+        }
+    }
+
+    // Two integers separated by a comma, e.g. 20,5
+    void read_int_pair(int &first, int &second) {
+        const char *begin, *field_end;
+        if(!field(begin, field_end)) {
+            return;
+        }
+        const char *comma = begin;
+        while(comma < field_end && *comma != ',') {
+            comma++;
+        }
+        if(comma == field_end || !parse_int(begin, comma, first) || !parse_int(comma + 1, field_end, second)) {
+            error(begin, "expected two integers separated by ','");
+        }
+    }
+
+    template<size_t N>
+    void read_enum(const EnumName (&names)[N], int &value) {
+        const char *begin, *field_end;
+        if(!field(begin, field_end)) {
+            return;
+        }
+        size_t length = field_end - begin;
+        for(size_t i = 0; i < N; i++) {
+            if(strlen(names[i].name) == length && memcmp(names[i].name, begin, length) == 0) {
+                value = names[i].value;
+                return;
+            }
+        }
+        error(begin, "unknown enum value");
+    }
+};
+
+static bool parse_weapons(const std::string &file_name, std::vector<Weapon> &weapons, std::vector<bool> &defined) {
+    MappedFile file;
+    if(!Files::map(file_name, file)) {
+        Engine::logn("[DB] unable to open %s", file_name.c_str());
+        return false;
+    }
+
+    DataParser parser(WEAPONS_FILE, file);
+    parser.next_line(); // ignore header
+    // id|name|reload_time|damage|accuracy|ProjectileType|projectile_count|burst_delay|radius|projectile_speed|projectile_speed_increase|projectile_speed_max
+    while(parser.next_line()) {
+        Weapon w;
+        WeaponId id = -1;
+        int projectile_type = 0;
+        parser.read_int(id);
+        parser.read_string(w.name);
+        parser.read_float(w.reload_time);
+        parser.read_int(w.damage);
+        parser.read_float(w.accuracy);
+        parser.read_enum(projectile_type_names, projectile_type);
+        parser.read_int(w.projectile_count);
+        parser.read_float(w.burst_delay);
+        parser.read_int(w.radius);
+        parser.read_float(w.projectile_speed);
+        parser.read_float(w.projectile_speed_increase);
+        parser.read_float(w.projectile_speed_max);
+        w.projectile_type = (ProjectileType)projectile_type;
+
+        if(!parser.failed && (id < 0 || id > DataBinary::MAX_ID)) {
+            parser.error(parser.line_start, "weapon id out of range");
+        }
+        if(!parser.failed && id < (int)defined.size() && defined[id]) {
+            parser.error(parser.line_start, "duplicate weapon id");
+        }
+        if(parser.failed) {
+            break;
+        }
+        if(id >= (int)weapons.size()) {
+            weapons.resize(id + 1);
+            defined.resize(id + 1, false);
+        }
+        weapons[id] = w;
+        defined[id] = true;
+    }
+
+    Files::unmap(file);
+    return !parser.failed;
+}
+
+// weapon_defined is the weapons table that will be live with these fighters
+static bool parse_fighters(const std::string &file_name, std::vector<FighterConfig> &fighters, const std::vector<bool> &weapon_defined) {
+    MappedFile file;
+    if(!Files::map(file_name, file)) {
+        Engine::logn("[DB] unable to open %s", file_name.c_str());
+        return false;
+    }
+
+    DataParser parser(FIGHTERS_FILE, file);
+    parser.next_line(); // ignore header
+    // id|name|type|cost|energy_cost|sprite|defense|weapons
+    std::vector<bool> seen;
+    while(parser.next_line()) {
+        FighterConfig f;
+        int type = 0;
+        WeaponConfig w;
+        int targeting = 0;
+        parser.read_int(f.id);
+        parser.read_string(f.name);
+        parser.read_enum(fighter_type_names, type);
+        parser.read_int_pair(f.cost.resource, f.cost.population);
+        parser.read_int(f.energy_cost);
+        parser.read_string(f.sprite_base);
+        parser.read_int_pair(f.defense.hp, f.defense.shield);
+        parser.read_int_pair(targeting, w.weapon_id);
+        f.type = (FighterType)type;
+        w.targeting = (short)targeting;
+        f.weapons.push_back(w);
+
+        if(!parser.failed && (f.id < 0 || f.id > DataBinary::MAX_ID)) {
+            parser.error(parser.line_start, "fighter id out of range");
+        }
+        if(!parser.failed && f.id < (int)seen.size() && seen[f.id]) {
+            parser.error(parser.line_start, "duplicate fighter id");
+        }
+        if(!parser.failed && (w.weapon_id < 0 || w.weapon_id >= (int)weapon_defined.size() || !weapon_defined[w.weapon_id])) {
+            parser.error(parser.line_start, "unknown weapon id");
+        }
+        if(parser.failed) {
+            break;
+        }
+        if(f.id >= (int)seen.size()) {
+            seen.resize(f.id + 1, false);
+        }
+        seen[f.id] = true;
+        fighters.push_back(f);
+    }
+
+    Files::unmap(file);
+    return !parser.failed;
 }
 
-void load_fighters() {
-    std::string file = "fighter.data";
-    std::string file_name = Engine::get_base_data_folder() + file;
-    std::ifstream fighter_data(file_name);
+static void build_indices() {
+    _fighter_index_by_id.clear();
+    _fighter_stats.clear();
+    for(size_t i = 0; i < _fighters.size(); i++) {
+        auto &f = _fighters[i];
+        ASSERT_WITH_MSG(f.id >= 0, Text::format("Invalid fighter id: %d", f.id));
+        if(f.id >= (int)_fighter_index_by_id.size()) {
+            _fighter_index_by_id.resize(f.id + 1, -1);
+        }
+        ASSERT_WITH_MSG(_fighter_index_by_id[f.id] == -1, Text::format("Duplicate fighter id: %d", f.id));
+        _fighter_index_by_id[f.id] = (int)i;
+        _fighter_stats.push_back(FighterStats { f.type, f.energy_cost, f.cost, f.defense });
+    }
+}
+
+// Offsets come from the file, the string has to start and end inside the string table
+static bool binary_string(const char *strings, uint32_t string_size, uint32_t offset, std::string &value) {
+    if(offset >= string_size) {
+        return false;
+    }
+    const char *end = (const char*)memchr(strings + offset, '\0', string_size - offset);
+    if(end == NULL) {
+        return false;
+    }
+    value.assign(strings + offset, end);
+    return true;
+}
+
+// Everything read from the file is checked before use, a truncated or stale file is
+// rejected and the caller parses the text files instead
+static bool load_binary(const std::string &file_name) {
+    using namespace DataBinary;
+
+    MappedFile file;
+    if(!Files::map(file_name, file)) {
+        return false;
+    }
+
+    const Header *header = (const Header*)file.data;
+    if(file.size < sizeof(Header) || header->magic != MAGIC || header->version != VERSION) {
+        Engine::logn("[DB] %s is not a valid data file", file_name.c_str());
+        Files::unmap(file);
+        return false;
+    }
+
+    uint64_t expected_size = sizeof(Header) 
+        + (uint64_t)header->weapon_count * sizeof(WeaponRecord)
+        + (uint64_t)header->fighter_count * sizeof(FighterRecord) 
+        + (uint64_t)header->fighter_weapon_count * sizeof(FighterWeaponRecord)
+        + header->string_size;
+    if((uint64_t)file.size != expected_size) {
+        Engine::logn("[DB] %s has wrong size", file_name.c_str());
+        Files::unmap(file);
+        return false;
+    }
+
+    const WeaponRecord *weapon_records = (const WeaponRecord*)(file.data + sizeof(Header));
+    const FighterRecord *fighter_records = (const FighterRecord*)(weapon_records + header->weapon_count);
+    const FighterWeaponRecord *fighter_weapons = (const FighterWeaponRecord*)(fighter_records + header->fighter_count);
+    const char *strings = (const char*)(fighter_weapons + header->fighter_weapon_count);
+    const uint32_t string_size = header->string_size;
+
+    std::vector<Weapon> weapons;
+    std::vector<bool> weapon_defined;
+    std::vector<FighterConfig> fighters;
+    std::vector<bool> fighter_seen;
+    const char *error = NULL;
+
+    for(uint32_t i = 0; i < header->weapon_count && error == NULL; i++) {
+        const WeaponRecord &r = weapon_records[i];
+        Weapon w;
+        if(r.id < 0 || r.id > MAX_ID) {
+            error = "weapon id out of range";
+            break;
+        }
+        if(r.id < (int)weapon_defined.size() && weapon_defined[r.id]) {
+            error = "duplicate weapon id";
+            break;
+        }
+        if(!binary_string(strings, string_size, r.name, w.name)) {
+            error = "bad weapon name";
+            break;
+        }
+        w.reload_time = r.reload_time;
+        w.damage = r.damage;
+        w.accuracy = r.accuracy;
+        w.projectile_type = (ProjectileType)r.projectile_type;
+        w.projectile_count = r.projectile_count;
+        w.burst_delay = r.burst_delay;
+        w.radius = r.radius;
+        w.projectile_speed = r.projectile_speed;
+        w.projectile_speed_increase = r.projectile_speed_increase;
+        w.projectile_speed_max = r.projectile_speed_max;
+        if(r.id >= (int)weapons.size()) {
+            weapons.resize(r.id + 1);
+            weapon_defined.resize(r.id + 1, false);
+        }
+        weapons[r.id] = w;
+        weapon_defined[r.id] = true;
+    }
+
+    for(uint32_t i = 0; i < header->fighter_count && error == NULL; i++) {
+        const FighterRecord &r = fighter_records[i];
+        FighterConfig f;
+        if(r.id < 0 || r.id > MAX_ID) {
+            error = "fighter id out of range";
+            break;
+        }
+        if(r.id < (int)fighter_seen.size() && fighter_seen[r.id]) {
+            error = "duplicate fighter id";
+            break;
+        }
+        if(!binary_string(strings, string_size, r.name, f.name) || !binary_string(strings, string_size, r.sprite_base, f.sprite_base)) {
+            error = "bad fighter string";
+            break;
+        }
+        if(r.weapon_first > header->fighter_weapon_count || r.weapon_count > header->fighter_weapon_count - r.weapon_first) {
+            error = "fighter weapons out of range";
+            break;
+        }
+        f.id = r.id;
+        f.type = (FighterType)r.type;
+        f.cost = Cost(r.cost_resource, r.cost_population);
+        f.energy_cost = r.energy_cost;
+        f.defense.hp = r.hp;
+        f.defense.shield = r.shield;
+        for(uint32_t w = r.weapon_first; w < r.weapon_first + r.weapon_count; w++) {
+            WeaponConfig wc;
+            wc.weapon_id = fighter_weapons[w].weapon_id;
+            wc.targeting = (short)fighter_weapons[w].targeting;
+            if(wc.weapon_id < 0 || wc.weapon_id >= (int)weapon_defined.size() || !weapon_defined[wc.weapon_id]) {
+                error = "unknown weapon id";
+                break;
+            }
+            f.weapons.push_back(wc);
+        }
+        if(r.id >= (int)fighter_seen.size()) {
+            fighter_seen.resize(r.id + 1, false);
+        }
+        fighter_seen[r.id] = true;
+        fighters.push_back(f);
+    }
+
+    Files::unmap(file);
+    if(error != NULL) {
+        Engine::logn("[DB] %s: %s", file_name.c_str(), error);
+        return false;
+    }
 
-    if (!fighter_data.is_open()) {
-        Engine::logn("ERROR: No data in fighter.data");
-        Engine::exit();
+    _weapons.swap(weapons);
+    _weapon_defined.swap(weapon_defined);
+    _fighters.swap(fighters);
+    return true;
+}
+
+static void save_binary(const std::string &file_name) {
+    using namespace DataBinary;
+
+    std::string strings;
+    auto add_string = [&](const std::string &s) {
+        uint32_t offset = (uint32_t)strings.size();
+        strings.append(s.c_str(), s.size() + 1);
+        return offset;
+    };
+
+    std::vector<WeaponRecord> weapons;
+    for(size_t i = 0; i < _weapons.size(); i++) {
+        if(!_weapon_defined[i]) {
+            continue;
+        }
+        const Weapon &w = _weapons[i];
+        weapons.push_back(WeaponRecord { (int32_t)i, add_string(w.name), w.reload_time, w.damage, w.accuracy, 
+            (int32_t)w.projectile_type, w.projectile_count, w.burst_delay, w.radius, 
+            w.projectile_speed, w.projectile_speed_increase, w.projectile_speed_max });
+    }
+
+    std::vector<FighterRecord> fighters;
+    std::vector<FighterWeaponRecord> fighter_weapons;
+    for(auto &f : _fighters) {
+        fighters.push_back(FighterRecord { f.id, add_string(f.name), add_string(f.sprite_base), (int32_t)f.type, 
+            f.cost.resource, f.cost.population, f.energy_cost, f.defense.hp, f.defense.shield, 
+            (uint32_t)fighter_weapons.size(), (uint32_t)f.weapons.size() });
+        for(auto &w : f.weapons) {
+            fighter_weapons.push_back(FighterWeaponRecord { w.weapon_id, w.targeting });
+        }
+    }
+
+    Header header = { MAGIC, VERSION, (uint32_t)weapons.size(), (uint32_t)fighters.size(), (uint32_t)fighter_weapons.size(), (uint32_t)strings.size() };
+
+    std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+    if(!out) {
+        Engine::logn("[DB] unable to write %s", file_name.c_str());
         return;
     }
-    
-    if(fighter_data) {
-        std::map<std::string, FighterType> f_type = {
-            {  "FighterType::Interceptor", FighterType::Interceptor } ,
-            {  "FighterType::Cruiser", FighterType::Cruiser } ,
-            {  "FighterType::Destroyer", FighterType::Destroyer }
-        };
-        
-        std::string line;
-        std::getline(fighter_data, line); // ignore header
-        // id|name|type|cost|energy_cost|sprite|defense|weapons
-        while (std::getline(fighter_data, line)) {
-            FighterConfig f;
-            std::istringstream data(line);
-            std::string value;
-            std::getline(data, value, '|');
-            f.id = std::stoi(value);
-            std::getline(data, value, '|');
-            f.name = value;
-            std::getline(data, value, '|');
-            f.type = f_type[value];
-            
-            std::getline(data, value, '|');
-            auto index = value.find_first_of(',');
-            f.cost.resource = std::stoi(value.substr(0, index));
-            f.cost.population = std::stoi(value.substr(index + 1, value.size() - 1));
-            
-            std::getline(data, value, '|');
-            f.energy_cost = std::stoi(value);
-            
-            std::getline(data, value, '|');
-            f.sprite_base = value;
-
-            std::getline(data, value, '|');
-            auto defense_index = value.find_first_of(',');
-            f.defense.hp = std::stoi(value.substr(0, defense_index)); 
-            f.defense.shield = std::stoi(value.substr(defense_index + 1, value.size() - 1));
-            
-            std::getline(data, value, '|');
-            auto weapon_index = value.find_first_of(',');
-            WeaponConfig w;
-            w.targeting = (short)std::stoi(value.substr(0, weapon_index)); 
-            w.weapon_id = std::stoi(value.substr(weapon_index + 1, value.size() - 1));
-            f.weapons.push_back(w);
-            
-            _fighters.push_back(f);
-        }
-    }
-    // if(weapon_data) {
-    //     std::map<std::string, ProjectileType> proj = {
-    //         {  "ProjectileType::Bullet", ProjectileType::Bullet } ,
-    //         {  "ProjectileType::LazerBeamGreen", ProjectileType::LazerBeamGreen } ,
-    //         {  "ProjectileType::LazerBulletRed", ProjectileType::LazerBulletRed } ,
-    //         {  "ProjectileType::LazerBulletRedLarge", ProjectileType::LazerBulletRedLarge } ,
-    //         {  "ProjectileType::Missile", ProjectileType::Missile } ,
-    //         {  "ProjectileType::SmallBullet", ProjectileType::SmallBullet } 
-    //     };
-    //     Weapon w;
-        
-    //     std::string line;
-    //     std::getline(weapon_data, line); // ignore header
-    //     while (std::getline(weapon_data, line)) {
-    //         std::istringstream data(line);
-    //         std::string value;
-    //         std::getline(data, w.name, '|');
-    //         std::getline(data, value, '|');
-    //         w.reload_time = std::stof(value);
-    //         std::getline(data, value, '|');
-    //         w.damage = std::stoi(value);
-    //         std::getline(data, value, '|');
-    //         w.accuracy = std::stof(value);
-            
-    //         std::getline(data, value, '|');
-    //         w.projectile_type = proj[value];
-
-    //         std::getline(data, value, '|');
-    //         w.projectile_count = std::stoi(value);
-
-    //         std::getline(data, value, '|');
-    //         w.burst_delay = std::stof(value);
-
-    //         std::getline(data, value, '|');
-    //         w.radius = std::stoi(value);
-
-    //         std::getline(data, value, '|');
-    //         w.projectile_speed = std::stof(value);
-
-    //         std::getline(data, value, '|');
-    //         w.projectile_speed_increase = std::stof(value);
-    //         std::getline(data, value, '|');
-    //         w.projectile_speed_max = std::stof(value);
-    //     }
-    // } else {
-    //     Engine::log("\n[WARNING] unable to open weapons file");
-    // }
+    out.write((const char*)&header, sizeof(Header));
+    out.write((const char*)weapons.data(), weapons.size() * sizeof(WeaponRecord));
+    out.write((const char*)fighters.data(), fighters.size() * sizeof(FighterRecord));
+    out.write((const char*)fighter_weapons.data(), fighter_weapons.size() * sizeof(FighterWeaponRecord));
+    out.write(strings.data(), strings.size());
 }
 
+static FileWatcher data_watcher;
+static const size_t WATCH_WEAPONS = 0;
+static const size_t WATCH_FIGHTERS = 1;
+
 void DB::load() {
-    load_weapons();
-    load_fighters();  
+    std::string folder = Engine::get_base_data_folder();
+    std::string binary_file = folder + DB_BINARY_FILE;
+    int64_t binary_time = Files::modified_time(binary_file);
+    bool binary_is_fresh = binary_time > 0
+        && binary_time > Files::modified_time(folder + WEAPONS_FILE)
+        && binary_time > Files::modified_time(folder + FIGHTERS_FILE);
+
+    if(binary_is_fresh && load_binary(binary_file)) {
+        Engine::logn("[DB] loaded %s", binary_file.c_str());
+    } else {
+        _weapons.clear();
+        _weapon_defined.clear();
+        _fighters.clear();
+        if(!parse_weapons(folder + WEAPONS_FILE, _weapons, _weapon_defined) || !parse_fighters(folder + FIGHTERS_FILE, _fighters, _weapon_defined)) {
+            Engine::logn("ERROR: Unable to load data files");
+            Engine::exit();
+            return;
+        }
+        save_binary(binary_file);
+    }
+
+    build_indices();
+
+    Files::watch_init(data_watcher, folder, { WEAPONS_FILE, FIGHTERS_FILE });
+}
+
+bool DB::hot_reload() {
+    uint32_t changed = Files::watch_poll(data_watcher);
+    if(changed == 0) {
+        return false;
+    }
+
+    // Parse into new tables and only swap when everything checks out, so a broken file keeps the old ones.
+    // Fighters are checked against the weapons that will be live, so they are parsed again when weapons change.
+    std::string folder = Engine::get_base_data_folder();
+    const bool weapons_changed = (changed & (1 << WATCH_WEAPONS)) != 0;
+    std::vector<Weapon> weapons;
+    std::vector<bool> weapon_defined;
+    if(weapons_changed && !parse_weapons(folder + WEAPONS_FILE, weapons, weapon_defined)) {
+        return false;
+    }
+    std::vector<FighterConfig> fighters;
+    if(!parse_fighters(folder + FIGHTERS_FILE, fighters, weapons_changed ? weapon_defined : _weapon_defined)) {
+        return false;
+    }
+
+    if(weapons_changed) {
+        _weapons.swap(weapons);
+        _weapon_defined.swap(weapon_defined);
+        Engine::logn("[DB] reloaded %s", WEAPONS_FILE);
+    }
+    _fighters.swap(fighters);
+    build_indices();
+    if(changed & (1 << WATCH_FIGHTERS)) {
+        Engine::logn("[DB] reloaded %s", FIGHTERS_FILE);
+    }
+
+    save_binary(folder + DB_BINARY_FILE);
+    return true;
 }
 
-std::vector<FighterConfig> &DB::get_fighters() {
+const std::vector<FighterConfig> &DB::get_fighters() {
     return _fighters;
 }
 
 const FighterConfig &DB::get_fighter_config(int id) {
-    for(auto &f : _fighters) {
-        if(f.id == id) {
-            return f;
-        }
-    }
-    ASSERT_WITH_MSG(false, "Fighter config not found!");
+    ASSERT_WITH_MSG(id >= 0 && id < (int)_fighter_index_by_id.size() && _fighter_index_by_id[id] >= 0, Text::format("Fighter config not found: %d", id));
+    return _fighters[_fighter_index_by_id[id]];
+}
+
+const FighterStats &DB::get_fighter_stats(int id) {
+    ASSERT_WITH_MSG(id >= 0 && id < (int)_fighter_index_by_id.size() && _fighter_index_by_id[id] >= 0, Text::format("Fighter config not found: %d", id));
+    return _fighter_stats[_fighter_index_by_id[id]];
+}
+
+FighterType DB::get_fighter_type(int id) {
+    return get_fighter_stats(id).type;
 }
 
-const Weapon &DB::get_ability_weapon(int id) {
+const Weapon &DB::get_ability_weapon(WeaponId id) {
+    ASSERT_WITH_MSG(id >= 0 && id < (int)_weapons.size(), Text::format("Weapon not found: %d", id));
     return _weapons[id];
-    // return GLOBAL_BASE_WEAPON;
 }
\ No newline at end of file
@@ -27,6 +27,9 @@ enum FighterType {
     Destroyer
 };
 
+// Index into the weapon table, from the id column in weapons.data
+typedef int WeaponId;
+
 struct FighterConfig {
     int id;
     std::string name;
@@ -38,11 +41,26 @@ struct FighterConfig {
     int energy_cost;
 };
 
+// Hot fields of a FighterConfig, used when spawning and every frame
+struct FighterStats {
+    FighterType type;
+    int energy_cost;
+    Cost cost;
+    DefenseConfig defense;
+};
+
+// Tables are built once in load() and indexed by id, lookups are O(1).
+// If data/db.bin is newer than the .data files it is mapped instead of parsing text,
+// otherwise the text is parsed and db.bin is written for the next start.
 struct DB {
     void load();
-    std::vector<FighterConfig> &get_fighters();
+    // Reloads .data files that changed on disk, true if any table was replaced
+    bool hot_reload();
+    const std::vector<FighterConfig> &get_fighters();
     const FighterConfig &get_fighter_config(int id);
-    const Weapon &get_ability_weapon(int id);
+    const FighterStats &get_fighter_stats(int id);
+    FighterType get_fighter_type(int id);
+    const Weapon &get_ability_weapon(WeaponId id);
 };
 
 #endif
\ No newline at end of file
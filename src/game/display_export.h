@@ -8,31 +8,72 @@
 #include "battle_controller.h"
 #include "data_repository.h"
 
-void export_sprite_data(const Position &position, const SpriteComponent &sprite, SpriteBufferData &spr, std::vector<SpriteSheet> *sprite_sheets);
+// Extra space around the camera so rotated sprites and lazers don't pop at the edges
+const int CULL_MARGIN = 32;
+
+void export_sprite_data(const Position &position, const SpriteComponent &sprite, const Vector2 &camera, const float alpha, SpriteBufferData &spr);
+
+Rectangle export_view_rect() {
+    const Vector2 camera = camera_render_position();
+    return Rectangle((int)camera.x - CULL_MARGIN, (int)camera.y - CULL_MARGIN, (int)gw + CULL_MARGIN * 2, (int)gh + CULL_MARGIN * 2);
+}
+
+bool sprite_in_view(const Position &position, const SpriteComponent &sprite, const Rectangle &view) {
+    // conservative bounds, half the largest side covers any rotation within the margin
+    float center_x, center_y;
+    int extent;
+    if(sprite.line) {
+        center_x = position.last.x + sprite.w / 2;
+        center_y = position.last.y + sprite.h / 2;
+        extent = (sprite.w > sprite.h ? sprite.w : sprite.h) / 2;
+    } else {
+        auto &sprite_frame = sprite.get_current_frame();
+        center_x = position.value.x;
+        center_y = position.value.y;
+        extent = (sprite_frame.w > sprite_frame.h ? sprite_frame.w : sprite_frame.h) / 2;
+    }
+    return center_x + extent >= view.x && center_x - extent <= view.x + view.w
+        && center_y + extent >= view.y && center_y - extent <= view.y + view.h;
+}
 
 template<typename T>
-void export_entities(std::vector<T> &entities, SpriteBufferData *sprite_data_buffer, std::vector<SpriteSheet> *sprite_sheets, int &sprite_count) {
+void export_entities(std::vector<T> &entities, RenderBuffer &render_buffer, const Rectangle &view, const Vector2 &camera, const float alpha) {
     for(size_t i = 0; i < entities.size(); i++) {
-        export_sprite_data(entities[i].position, entities[i].sprite, sprite_data_buffer[sprite_count++], sprite_sheets);
+        if(!sprite_in_view(entities[i].position, entities[i].sprite, view)) {
+            render_buffer.culled_count++;
+            continue;
+        }
+        SpriteBufferData *spr = render_buffer.push();
+        if(spr == NULL) {
+            continue;
+        }
+        export_sprite_data(entities[i].position, entities[i].sprite, camera, alpha, *spr);
     }
 }
 
-void render_export(RenderBuffer &render_buffer) {
+// Runs at render time, alpha is how far between the last two updates to draw (Time::alpha)
+void render_export(RenderBuffer &render_buffer, const float alpha) {
+    PROFILE_SCOPE("render export");
     render_buffer.clear();
-    auto *sprite_sheets = &Resources::get_sprite_sheets();
-    auto sprite_data_buffer = render_buffer.sprite_data_buffer;
-    auto &sprite_count = render_buffer.sprite_count;
+    const Rectangle view = export_view_rect();
+    const Vector2 camera = camera_render_position();
 
-    export_entities(BattleController::_motherships, sprite_data_buffer, sprite_sheets, sprite_count);
-    export_entities(BattleController::_fighter_ships, sprite_data_buffer, sprite_sheets, sprite_count);
-    export_entities(BattleController::_projectiles, sprite_data_buffer, sprite_sheets, sprite_count);
-    export_entities(BattleController::_projectile_missed, sprite_data_buffer, sprite_sheets, sprite_count);
+    export_entities(BattleController::_motherships, render_buffer, view, camera, alpha);
+    export_entities(BattleController::_fighter_ships, render_buffer, view, camera, alpha);
+    export_entities(BattleController::_projectiles, render_buffer, view, camera, alpha);
+    export_entities(BattleController::_projectile_missed, render_buffer, view, camera, alpha);
     
-    std::sort(sprite_data_buffer, sprite_data_buffer + sprite_count);
+    if(render_buffer.overflow_count > 0) {
+        LOG_WARNING(Log::Render, "buffer overflow, dropped %d sprites", render_buffer.overflow_count);
+    }
 
-    // Update UI State
-    // =================================
+    auto sprite_data_buffer = render_buffer.sprite_data_buffer;
+    auto sprite_count = render_buffer.sprite_count;
+    std::sort(sprite_data_buffer, sprite_data_buffer + sprite_count);
+}
 
+// Runs once per update
+void ui_export() {
     Services::ui()->frame();
     
     for(auto &ship : BattleController::_fighter_ships) {
@@ -76,7 +117,7 @@ void render_export(RenderBuffer &render_buffer) {
     for(auto &f : Services::game_state()->fighters) {
         std::string fighter_type_text = "";
         TextElement t;
-        auto fighter_type = Services::db()->get_fighter_config(f.id).type;
+        auto fighter_type = Services::db()->get_fighter_type(f.id);
         if(fighter_type == FighterType::Interceptor) {
             fighter_type_text = "Interceptors";
             t.position = Point(10, gh - 105);
@@ -101,11 +142,9 @@ void render_export(RenderBuffer &render_buffer) {
     Services::ui()->add_immediate_element(t);
 }
 
-void export_sprite_data(const Position &position, const SpriteComponent &sprite, SpriteBufferData &spr, std::vector<SpriteSheet> *sprite_sheets) {
+void export_sprite_data(const Position &position, const SpriteComponent &sprite, const Vector2 &camera, const float alpha, SpriteBufferData &spr) {
     // handle camera, zoom and stuff here
-
-    // also we can do culling here
-    // intersects world_bounds etc
+    // culling is done before this in export_entities
 
     // float globalScale = 0.05f;
     // spr.x = go.pos.x * globalScale;
@@ -114,26 +153,24 @@ void export_sprite_data(const Position &position, const SpriteComponent &sprite,
     // spr.x = entity_data.position[i].x - camera.x;
     // spr.x = entity_data.position[i].y - camera.y;
 
-    const auto &camera = get_camera();
-
     auto &sprite_frame = sprite.get_current_frame();
-    auto &sheet = sprite_sheets->at(sprite_frame.sprite_sheet_index);
-    auto &region = sheet.sheet_sprites[sheet.sprites_by_name.at(sprite_frame.sprite_name)].region;
-
-    spr.tex = Resources::sprite_get(sheet.sprite_sheet_name)->image;
-    spr.src = region;
+    spr.tex = sprite_frame.texture;
+    spr.src = sprite_frame.region;
 
     spr.angle = sprite.rotation;
     spr.layer = sprite.layer;
 
+    // lazers use last as their start so they aren't interpolated
     if(sprite.line) {
          spr.dest.x = (int16_t)(position.last.x - camera.x);
          spr.dest.y = (int16_t)(position.last.y - camera.y);
          spr.dest.w = sprite.w;
          spr.dest.h = sprite.h;
     } else {
-        spr.dest.x = (int16_t)(position.value.x - camera.x);
-        spr.dest.y = (int16_t)(position.value.y - camera.y);
+        const float x = Math::lerp(position.last.x, position.value.x, alpha);
+        const float y = Math::lerp(position.last.y, position.value.y, alpha);
+        spr.dest.x = (int16_t)(x - camera.x);
+        spr.dest.y = (int16_t)(y - camera.y);
 
         spr.dest.w = sprite_frame.w;
         spr.dest.h = sprite_frame.h;
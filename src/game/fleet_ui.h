@@ -17,7 +17,7 @@ struct FighterUIElement : public Element {
     void on_click(int id) {
         for(FighterData &f : Services::game_state()->fighters) {
             if(f.id == id) {
-                auto config = Services::db()->get_fighter_config(f.id);
+                auto &config = Services::db()->get_fighter_stats(f.id);
                 if(resources_available(Services::game_state()->resources, config.cost, 1)) {
                     f.count = f.count + 1;
                     _count = f.count;
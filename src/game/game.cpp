@@ -7,6 +7,13 @@
 #include "map_scene.h"
 #include "game_input_wrapper.h"
 // #include "_engine_test.h"
+#include "_benchmarks.h"
+
+static bool infinite_map = false;
+
+void game_set_infinite_map(bool enabled) {
+	infinite_map = enabled;
+}
 
 void game_load() {
 	// Allocate memory and load resources
@@ -14,8 +21,10 @@ void game_load() {
 	Font *font = Resources::font_load("normal", "pixeltype.ttf", 15);
 	set_default_font(font);
     FrameLog::enable_at(5, 5);
+    PerfHud::set_enabled(true);
 	
 	Services::init();
+	Services::game_state()->infinite_map = infinite_map;
 
 	Services::db()->load();
 
@@ -30,4 +39,8 @@ void game_load() {
 
 	SDL_ShowCursor(SDL_ENABLE);
 	// engine_test();
+}
+
+int game_benchmark(const char *dump_folder) {
+	return run_benchmarks(dump_folder);
 }
\ No newline at end of file
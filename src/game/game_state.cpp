@@ -8,15 +8,29 @@ void GameState::new_game() {
     //seed = RNG::range_i(0, 3000000);
     seed = 15;
 
+    start_node = Point(10, 10);
+    current_node = start_node;
+
+    // distances from the start follow every change to the maze
+    start_distances.origin = start_node;
+    maze.on_change = [this](Maze &changed, const MazeChange &change) {
+        maze_distance_field_update(&changed, start_distances, change);
+    };
+
     maze_generate(maze, 22, 22);
-	maze_grow_tree(&maze);
+    MazeGrowSettings maze_settings;
+    maze_settings.seed = (uint32_t)seed;
+	maze_grow_tree(&maze, maze_settings);
 
     // std::ostringstream out;
     // maze_log(&maze, out);
     // Engine::logn(out.str().c_str());
     
-    start_node = Point(10, 10);
-    current_node = start_node;
+    if(infinite_map) {
+        map_chunks.init(seed);
+        _infinite_visited.clear();
+        _infinite_completed.clear();
+    }
     //maze_open_all(&maze);
     
     // mothership.abilities;
@@ -74,25 +88,71 @@ void GameState::new_game() {
     );
 }
 
+static uint64_t node_key(const Point &p) {
+    return ((uint64_t)(uint32_t)p.x << 32) | (uint32_t)p.y;
+}
+
 void GameState::set_current_node(const Point &next_node) {
     current_node = next_node;
     
-    int distance = (int)Math::distance_v(current_node.to_vector2(), start_node.to_vector2());
-    node_distance = distance;
-    _visited_nodes.push_back(current_node);    
+    if(infinite_map) {
+        node_distance = std::abs(current_node.x - start_node.x) + std::abs(current_node.y - start_node.y);
+        _infinite_visited.insert(node_key(current_node));
+        return;
+    }
+
+    // steps through the maze, not straight line distance
+    uint32_t distance = start_distances.at(current_node);
+    node_distance = distance != MAZE_UNREACHABLE ? (int)distance : 0;
+    maze.set_visited(current_node.x, current_node.y);
 }
 
 void GameState::set_current_node_completed() {
     _last_completed_node = current_node;
+    if(infinite_map) {
+        _infinite_completed.insert(node_key(current_node));
+        return;
+    }
+    maze.set_completed(current_node.x, current_node.y);
 }
 
 bool GameState::is_visited(const Point &n) {
-    bool is_node_visited = false;
-    for(auto &node : _visited_nodes) {
-        if(node == n) {
-            is_node_visited = true;
-            break;
-        }
+    if(infinite_map) {
+        return _infinite_visited.count(node_key(n)) > 0;
     }
-    return is_node_visited;
-}
\ No newline at end of file
+    return maze.is_visited(n.x, n.y);
+}
+
+bool GameState::is_completed(const Point &n) {
+    if(infinite_map) {
+        return _infinite_completed.count(node_key(n)) > 0;
+    }
+    return maze.is_completed(n.x, n.y);
+}
+
+bool GameState::route_to(const Point &target, std::vector<Point> &path) {
+    if(infinite_map) {
+        // no route hints on the unbounded map, it has no fixed maze to search
+        path.clear();
+        return false;
+    }
+    return maze_path_astar(&maze, maze_search, current_node, target, path);
+}
+
+bool GameState::connection_is_open(const Point &from, const Point &to) {
+    if(!infinite_map) {
+        return maze_connection_is_open(&maze, from, to);
+    }
+
+    Directions direction = Directions::None;
+    if(to.x == from.x && to.y == from.y - 1) direction = Directions::North;
+    else if(to.x == from.x && to.y == from.y + 1) direction = Directions::South;
+    else if(to.x == from.x - 1 && to.y == from.y) direction = Directions::West;
+    else if(to.x == from.x + 1 && to.y == from.y) direction = Directions::East;
+    if(direction == Directions::None) {
+        return false;
+    }
+    const MapChunk &chunk = map_chunks.require(MapChunkCache::chunk_of(from.x), MapChunkCache::chunk_of(from.y));
+    const int i = MapChunkCache::local_of(from.y) * MAP_CHUNK_SIZE + MapChunkCache::local_of(from.x);
+    return (chunk.openings[i] & direction) == direction;
+}
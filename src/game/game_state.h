@@ -4,6 +4,9 @@
 #include "abilities.h"
 #include "data_repository.h"
 #include "maze.h"
+#include "map_chunks.h"
+
+#include <unordered_set>
 
 struct Point;
 struct Maze;
@@ -53,17 +56,29 @@ struct GameState {
     void set_current_node(const Point &next_node);
     void set_current_node_completed();
     bool is_visited(const Point &node);
+    bool is_completed(const Point &node);
+    // path from the current node, reuses maze_search so no allocations once warm
+    bool route_to(const Point &target, std::vector<Point> &path);
+    // neighbouring nodes only, works for both map modes
+    bool connection_is_open(const Point &from, const Point &to);
 
     int seed;
     int difficulty = 0;
     int node_distance = 0;
 
     Maze maze;
+    MazeDistanceField start_distances;
+    MazeSearch maze_search;
     Point start_node;
     Point current_node;
     Point _last_completed_node;
 
-    std::vector<Point> _visited_nodes;
+    // Unbounded map streamed from map_chunks instead of the fixed maze,
+    // set before new_game (--infinite-map)
+    bool infinite_map = false;
+    MapChunkCache map_chunks;
+    std::unordered_set<uint64_t> _infinite_visited;
+    std::unordered_set<uint64_t> _infinite_completed;
 
     MothershipConfig mothership;
     std::vector<FighterData> fighters;
@@ -1,5 +1,6 @@
 #include "level_scene.h"
 #include "battle_controller.h"
+#include "unit_creator.h"
 #include "systems.h"
 #include "display_export.h"
 #include "particles.h"
@@ -7,7 +8,6 @@
 #include "game_input_wrapper.h"
 #include "immediate_gui.h"
 
-#include <chrono>
 
 bool battle_over = false;
 
@@ -22,6 +22,7 @@ void LevelScene::initialize() {
 
 void LevelScene::begin() {
 	Engine::logn("[LEVEL] Begin");
+    _background = Resources::sprite_acquire("background");
     BattleController::create(Services::game_state());
 
     // SelectBox s_box;
@@ -67,16 +68,21 @@ void LevelScene::end() {
     Services::ui()->clear();
     
     battle_over = false;
+    Resources::sprite_release(_background);
 }
 
 int test = 4;
 
 void LevelScene::update() {
-    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
-	
+    PROFILE_SCOPE("level update");
 
     IGUI::number_edit_i("test", &test, 0, 10, 1);
 
+    // new configs apply to ships spawned after the reload
+    if(Services::db()->hot_reload()) {
+        UnitCreator::build_prefabs();
+    }
+
 
     BattleController::update();
     Particles::update(BattleController::particles, Time::delta_time);
@@ -108,26 +114,30 @@ void LevelScene::update() {
             gs->fighters, gs->fighters_max, PLAYER_FACTION);
 	}
     
-    render_export(render_buffer);
-
-	std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
-	auto diff = t2 - t1;
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>( diff ).count();
-	auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>( diff ).count();
-	std::string frame_duration_mu = "update time mu: " + std::to_string(duration);
-	std::string frame_duration_ms = "update time ms: " + std::to_string(duration_ms);
-	FrameLog::log(frame_duration_mu);
-	FrameLog::log(frame_duration_ms);
-
-    FrameLog::log("projectiles: " + std::to_string(BattleController::_projectiles.size()));
-    FrameLog::log("projectiles missed: " + std::to_string(BattleController::_projectile_missed.size()));
+    ui_export();
+
+    FlightRecorder::counter("projectiles", (int64_t)BattleController::_projectiles.size());
+    FlightRecorder::counter("projectiles missed", (int64_t)BattleController::_projectile_missed.size());
+    FlightRecorder::counter("ships", (int64_t)(BattleController::_fighter_ships.size() + BattleController::_motherships.size()));
+    FlightRecorder::counter("particles", BattleController::particles.length);
+
+    PerfHud::counter("projectiles", (int64_t)BattleController::_projectiles.size());
+    PerfHud::counter("projectiles missed", (int64_t)BattleController::_projectile_missed.size());
+    PerfHud::counter("sprites", render_buffer.sprite_count);
+    PerfHud::counter("culled", render_buffer.culled_count);
+    auto &cache = Resources::cache_stats();
+    PerfHud::counter("texture kb", (int64_t)(cache.resident_bytes / 1024));
+    PerfHud::counter("texture hits", (int64_t)cache.hits);
+    PerfHud::counter("texture misses", (int64_t)cache.misses);
+    PerfHud::counter("texture evictions", (int64_t)cache.evictions);
 }
 
 void LevelScene::render() {
 	renderer_clear();
     // Render Background
-    draw_sprite(Resources::sprite_get("background"), 0, 0);
+    draw_sprite(_background.sprite, 0, 0);
     
+    render_export(render_buffer, Time::alpha);
     draw_buffer(render_buffer);
     Particles::render_circles_filled(BattleController::particles);
     
@@ -0,0 +1,285 @@
+#include "map_chunks.h"
+#include "renderer.h"
+#include "maze.h"
+
+#include <thread>
+
+float pseudo_rand_zero_to_one(uint32_t x, uint32_t y) {
+	/* mix around the bits in x: */
+	x = x * 3266489917 + 374761393;
+	x = (x << 17) | (x >> 15);
+
+	/* mix around the bits in y and mix those into x: */
+	x += y * 3266489917;
+
+	/* Give x a good stir: */
+	x *= 668265263;
+	x ^= x >> 15;
+	x *= 2246822519;
+	x ^= x >> 13;
+	x *= 3266489917;
+	x ^= x >> 16;
+
+	/* trim the result and scale it to a float in [0,1): */
+	return (x & 0x00ffffff) * (1.0f / 0x1000000);
+}
+
+const int node_distribution_count = 20;
+const int nodes_distribution[node_distribution_count] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3 };
+
+int get_node_type(uint32_t x, uint32_t y) {
+    return nodes_distribution[(int)(pseudo_rand_zero_to_one(x, y) * node_distribution_count)];
+}
+
+SDL_Color get_node_color(int type) {
+    if(type == 1) {
+        return { 65, 120, 200, 255 };
+    } else if(type == 2) {
+        return { 255, 0, 0, 255 };
+    } else if(type == 3) {
+        return { 255, 255, 0, 255 };
+    }
+    ASSERT_WITH_MSG(false, "get_node_color: non specified node type");
+    return Colors::white;
+}
+
+Node get_node(int x, int y, int seed) {
+    Node node;
+    
+    int id = get_node_type(x + seed, y + seed);
+    //int n = pseudo_rand_zero_to_one(x, y);
+
+    node.type = id;
+    node.color = get_node_color(id);
+    return node;
+}
+
+// Only called when the layout or a chunk is built, not per frame
+Point get_node_displacement(int node_x, int node_y, int seed) {
+    uint32_t r_seed = (uint32_t)(pseudo_rand_zero_to_one(node_x + seed, node_y + seed) * 3450971324.f);
+    std::mt19937 id_displacement(r_seed);
+
+    Point p(RNG::range_i(-20, 20, id_displacement), RNG::range_i(-20, 20, id_displacement));
+    return p;
+}
+
+static uint32_t chunk_hash(int seed, int x, int y, uint32_t salt) {
+    return (uint32_t)(pseudo_rand_zero_to_one((uint32_t)(x * 73856093) ^ salt, (uint32_t)(y * 19349663) ^ (uint32_t)seed) * 0x1000000);
+}
+
+void map_chunk_generate(MapChunk &chunk, int chunk_x, int chunk_y, int seed) {
+    chunk.chunk_x = chunk_x;
+    chunk.chunk_y = chunk_y;
+
+    Maze maze;
+    maze_generate(maze, MAP_CHUNK_SIZE, MAP_CHUNK_SIZE);
+    MazeGrowSettings settings;
+    settings.seed = chunk_hash(seed, chunk_x, chunk_y, 0);
+    maze_grow_tree(&maze, settings);
+    for(int y = 0; y < MAP_CHUNK_SIZE; y++) {
+        for(int x = 0; x < MAP_CHUNK_SIZE; x++) {
+            chunk.openings[y * MAP_CHUNK_SIZE + x] = (uint8_t)maze.openings(x, y);
+        }
+    }
+    maze_free(&maze);
+
+    // one passage to each neighbour, both sides hash the same shared edge
+    const int last = MAP_CHUNK_SIZE - 1;
+    chunk.openings[(chunk_hash(seed, chunk_x, chunk_y, 1) % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE + last] |= Directions::East;
+    chunk.openings[(chunk_hash(seed, chunk_x - 1, chunk_y, 1) % MAP_CHUNK_SIZE) * MAP_CHUNK_SIZE] |= Directions::West;
+    chunk.openings[last * MAP_CHUNK_SIZE + chunk_hash(seed, chunk_x, chunk_y, 2) % MAP_CHUNK_SIZE] |= Directions::South;
+    chunk.openings[chunk_hash(seed, chunk_x, chunk_y - 1, 2) % MAP_CHUNK_SIZE] |= Directions::North;
+
+    for(int y = 0; y < MAP_CHUNK_SIZE; y++) {
+        for(int x = 0; x < MAP_CHUNK_SIZE; x++) {
+            const int node_x = chunk_x * MAP_CHUNK_SIZE + x;
+            const int node_y = chunk_y * MAP_CHUNK_SIZE + y;
+            const int i = y * MAP_CHUNK_SIZE + x;
+            chunk.types[i] = (uint8_t)get_node_type(node_x + seed, node_y + seed);
+            Point d = get_node_displacement(node_x, node_y, seed);
+            chunk.displacement_x[i] = (int8_t)d.x;
+            chunk.displacement_y[i] = (int8_t)d.y;
+        }
+    }
+}
+
+// Slot state packs a ticket that changes every time the slot is handed out, so a
+// queued job for a chunk that was since replaced can't claim the slot again.
+static const uint32_t STATE_MASK = 3;
+static const uint32_t GENERATING = 3;
+
+static uint64_t chunk_key(int chunk_x, int chunk_y) {
+    return ((uint64_t)(uint32_t)chunk_x << 32) | (uint32_t)chunk_y;
+}
+
+// Whoever moves the slot from pending to generating makes the chunk
+static bool slot_claim(MapChunkCache::Slot &slot, uint32_t pending_state) {
+    return slot.state.compare_exchange_strong(pending_state, (pending_state & ~STATE_MASK) | GENERATING, std::memory_order_acquire);
+}
+
+static void slot_generate(MapChunkCache::Slot &slot, uint32_t pending_state, int seed) {
+    map_chunk_generate(slot.chunk, (int)(int32_t)(slot.key >> 32), (int)(int32_t)(uint32_t)slot.key, seed);
+    slot.state.store((pending_state & ~STATE_MASK) | MapChunkCache::Ready, std::memory_order_release);
+}
+
+// Free slot or the least recently used ready one not used this frame, -1 if none
+static int slot_acquire(MapChunkCache &cache, uint64_t key) {
+    int best = -1;
+    for(int i = 0; i < cache.capacity; i++) {
+        const uint32_t kind = cache.slots[i].state.load(std::memory_order_acquire) & STATE_MASK;
+        if(kind == MapChunkCache::Free) {
+            best = i;
+            break;
+        }
+        if(kind != MapChunkCache::Ready || cache.slots[i].last_used == cache.frame) {
+            continue;
+        }
+        if(best < 0 || cache.slots[i].last_used < cache.slots[best].last_used) {
+            best = i;
+        }
+    }
+    if(best < 0) {
+        return -1;
+    }
+
+    MapChunkCache::Slot &slot = cache.slots[best];
+    const uint32_t previous = slot.state.load(std::memory_order_relaxed);
+    if((previous & STATE_MASK) == MapChunkCache::Ready) {
+        cache.lookup.erase(slot.key);
+        cache.stats.evictions++;
+    }
+    slot.key = key;
+    slot.last_used = cache.frame;
+    slot.state.store((previous & ~STATE_MASK) + (1 << 2) + MapChunkCache::Pending, std::memory_order_release);
+    cache.lookup[key] = best;
+    return best;
+}
+
+void MapChunkCache::init(int map_seed, size_t memory_cap_bytes) {
+    free();
+    seed = map_seed;
+    // at least enough for the view and what is around it
+    capacity = std::max(64, (int)(memory_cap_bytes / sizeof(Slot)));
+    slots = new Slot[capacity]();
+    lookup.reserve(capacity);
+    frame = 0;
+    stats = Stats();
+    Engine::logn("[MAP] chunk cache, %d chunks, %d kb", capacity, (int)(memory_used() / 1024));
+}
+
+void MapChunkCache::free() {
+    while(jobs_outstanding.load() > 0) {
+        std::this_thread::yield();
+    }
+    delete[] slots;
+    slots = nullptr;
+    capacity = 0;
+    lookup.clear();
+}
+
+void MapChunkCache::frame_begin() {
+    frame++;
+}
+
+const MapChunk *MapChunkCache::find(int chunk_x, int chunk_y) {
+    auto it = lookup.find(chunk_key(chunk_x, chunk_y));
+    if(it == lookup.end()) {
+        return nullptr;
+    }
+    Slot &slot = slots[it->second];
+    slot.last_used = frame;
+    if((slot.state.load(std::memory_order_acquire) & STATE_MASK) != Ready) {
+        return nullptr;
+    }
+    return &slot.chunk;
+}
+
+const MapChunk &MapChunkCache::require(int chunk_x, int chunk_y) {
+    const uint64_t key = chunk_key(chunk_x, chunk_y);
+    auto it = lookup.find(key);
+    int index = it != lookup.end() ? it->second : slot_acquire(*this, key);
+    ASSERT_WITH_MSG(index >= 0, "MapChunkCache::require, every slot is in use");
+    
+    Slot &slot = slots[index];
+    slot.last_used = frame;
+    uint32_t state = slot.state.load(std::memory_order_acquire);
+    if((state & STATE_MASK) == Pending && slot_claim(slot, state)) {
+        // the worker hasn't started on it, quicker to make it here than to wait
+        slot_generate(slot, state, seed);
+        stats.generated++;
+        stats.generated_waiting++;
+    }
+    while((slot.state.load(std::memory_order_acquire) & STATE_MASK) != Ready) {
+        std::this_thread::yield();
+    }
+    return slot.chunk;
+}
+
+bool MapChunkCache::request(int chunk_x, int chunk_y) {
+    const uint64_t key = chunk_key(chunk_x, chunk_y);
+    auto it = lookup.find(key);
+    if(it != lookup.end()) {
+        slots[it->second].last_used = frame;
+        return true;
+    }
+
+    int index = slot_acquire(*this, key);
+    if(index < 0) {
+        stats.dropped++;
+        return false;
+    }
+
+    Slot *slot = &slots[index];
+    const uint32_t pending_state = slot->state.load(std::memory_order_relaxed);
+    const int chunk_seed = seed;
+    jobs_outstanding++;
+    Jobs::submit([this, slot, pending_state, chunk_seed]() {
+        if(slot_claim(*slot, pending_state)) {
+            slot_generate(*slot, pending_state, chunk_seed);
+        }
+        jobs_outstanding--;
+    });
+    stats.generated++;
+    return true;
+}
+
+void MapChunkCache::prefetch(const Rectangle &view, const Vector2 &velocity) {
+    const int x0 = chunk_of(view.x);
+    const int x1 = chunk_of(view.x + view.w - 1);
+    const int y0 = chunk_of(view.y);
+    const int y1 = chunk_of(view.y + view.h - 1);
+    for(int y = y0; y <= y1; y++) {
+        for(int x = x0; x <= x1; x++) {
+            request(x, y);
+        }
+    }
+
+    // where the view is heading in about half a second, at most two chunks ahead,
+    // plus one chunk all around in case it turns
+    const float lookahead = 30.0f;
+    const int ahead_x = (int)Math::clamp_f(velocity.x * lookahead / MAP_CHUNK_SIZE, -2.0f, 2.0f);
+    const int ahead_y = (int)Math::clamp_f(velocity.y * lookahead / MAP_CHUNK_SIZE, -2.0f, 2.0f);
+    const int from_x = std::min(x0 - 1, x0 + ahead_x);
+    const int to_x = std::max(x1 + 1, x1 + ahead_x);
+    const int from_y = std::min(y0 - 1, y0 + ahead_y);
+    const int to_y = std::max(y1 + 1, y1 + ahead_y);
+
+    // don't queue more than the workers can get through soon
+    const size_t max_queued = (size_t)std::max(1, Jobs::thread_count()) * 4;
+    for(int y = from_y; y <= to_y; y++) {
+        for(int x = from_x; x <= to_x; x++) {
+            if(x >= x0 && x <= x1 && y >= y0 && y <= y1) {
+                continue;
+            }
+            auto it = lookup.find(chunk_key(x, y));
+            if(it != lookup.end()) {
+                slots[it->second].last_used = frame;
+                continue;
+            }
+            if(Jobs::pending() >= max_queued) {
+                return;
+            }
+            request(x, y);
+        }
+    }
+}
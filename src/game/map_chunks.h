@@ -0,0 +1,88 @@
+#ifndef MAP_CHUNKS_H
+#define MAP_CHUNKS_H
+
+#include "engine.h"
+#include "map_node.h"
+
+#include <atomic>
+
+// Node types, colors and displacements only depend on (x, y, seed)
+float pseudo_rand_zero_to_one(uint32_t x, uint32_t y);
+int get_node_type(uint32_t x, uint32_t y);
+SDL_Color get_node_color(int type);
+Node get_node(int x, int y, int seed);
+Point get_node_displacement(int node_x, int node_y, int seed);
+
+// The unbounded map is split in MAP_CHUNK_SIZE x MAP_CHUNK_SIZE chunks generated
+// from the seed alone, so any chunk can be made in any order on any thread.
+// Each chunk is its own maze and opens one passage to every neighbouring chunk.
+const int MAP_CHUNK_SIZE = 16;
+const int MAP_CHUNK_CELLS = MAP_CHUNK_SIZE * MAP_CHUNK_SIZE;
+const size_t MAP_CHUNK_CACHE_BYTES = 4 * 1024 * 1024;
+
+struct MapChunk {
+    int chunk_x;
+    int chunk_y;
+    uint8_t openings[MAP_CHUNK_CELLS]; // Directions
+    uint8_t types[MAP_CHUNK_CELLS];
+    int8_t displacement_x[MAP_CHUNK_CELLS];
+    int8_t displacement_y[MAP_CHUNK_CELLS];
+};
+
+void map_chunk_generate(MapChunk &chunk, int chunk_x, int chunk_y, int seed);
+
+// Fixed number of chunk slots sized from a memory cap, least recently used chunks
+// are replaced so memory stays the same however far the map is explored.
+// Chunks are generated on Jobs workers ahead of the camera, require generates
+// on the calling thread if the worker hasn't got there yet.
+// Everything except the generation itself runs on one thread.
+struct MapChunkCache {
+    enum SlotState { Free, Pending, Ready };
+
+    struct Slot {
+        MapChunk chunk;
+        std::atomic<uint32_t> state;
+        uint64_t key;
+        uint32_t last_used;
+    };
+
+    struct Stats {
+        uint32_t generated = 0;
+        // had to be generated right away because it was needed before a worker made it
+        uint32_t generated_waiting = 0;
+        uint32_t evictions = 0;
+        // prefetches skipped because every slot was in use
+        uint32_t dropped = 0;
+    };
+
+    Slot *slots = nullptr;
+    int capacity = 0;
+    int seed = 0;
+    uint32_t frame = 0;
+    std::unordered_map<uint64_t, int> lookup;
+    Stats stats;
+    // jobs that still hold a slot pointer
+    std::atomic<int> jobs_outstanding { 0 };
+
+    void init(int map_seed, size_t memory_cap_bytes = MAP_CHUNK_CACHE_BYTES);
+    // waits for chunks still being generated
+    void free();
+    // chunks used after this count as used this frame and are never replaced during it
+    void frame_begin();
+
+    // null while the chunk is not generated yet
+    const MapChunk *find(int chunk_x, int chunk_y);
+    const MapChunk &require(int chunk_x, int chunk_y);
+    // starts generating on a worker, false if no slot could be freed
+    bool request(int chunk_x, int chunk_y);
+    // view and velocity in cells, requests the view and the area it is moving towards
+    void prefetch(const Rectangle &view, const Vector2 &velocity);
+
+    size_t memory_used() const { return (size_t)capacity * sizeof(Slot); }
+
+    // cells to chunks, rounding towards negative infinity
+    static int chunk_of(int cell) { return cell >= 0 ? cell / MAP_CHUNK_SIZE : (cell - MAP_CHUNK_SIZE + 1) / MAP_CHUNK_SIZE; }
+    static int local_of(int cell) { return cell - chunk_of(cell) * MAP_CHUNK_SIZE; }
+};
+
+#endif
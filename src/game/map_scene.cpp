@@ -7,35 +7,8 @@
 #include "map_node.h"
 #include "fleet_ui.h"
 #include "maze.h"
+#include "map_chunks.h"
 
-#include <chrono>
-
-float pseudo_rand_zero_to_one(uint32_t x, uint32_t y) {
-	/* mix around the bits in x: */
-	x = x * 3266489917 + 374761393;
-	x = (x << 17) | (x >> 15);
-
-	/* mix around the bits in y and mix those into x: */
-	x += y * 3266489917;
-
-	/* Give x a good stir: */
-	x *= 668265263;
-	x ^= x >> 15;
-	x *= 2246822519;
-	x ^= x >> 13;
-	x *= 3266489917;
-	x ^= x >> 16;
-
-	/* trim the result and scale it to a float in [0,1): */
-	return (x & 0x00ffffff) * (1.0f / 0x1000000);
-}
-
-const int node_distribution_count = 20;
-const int nodes_distribution[node_distribution_count] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 3 };
-
-int get_node_type(uint32_t x, uint32_t y) {
-    return nodes_distribution[(int)(pseudo_rand_zero_to_one(x, y) * node_distribution_count)];
-}
 
 const float max_distance = 15.0f;
 int distance_to(int nodeid_a, int nodeid_b) {
@@ -47,35 +20,53 @@ int get_node_id(int x, int y) {
     return x * arbitray_length + y;
 }
 
-Node get_node(int x, int y, int seed) {
-    Node node;
-    
-    int id = get_node_type(x + seed, y + seed);
-    //int n = pseudo_rand_zero_to_one(x, y);
-
-    node.type = id;
-
-    if(id == 1) {
-        node.color = { 65, 120, 200, 255 };
-    } else if(id == 2) {
-        node.color = { 255, 0, 0, 255 };
-    } else if(id == 3) {
-        node.color = { 255, 255, 0, 255 };
-    } else {
-        ASSERT_WITH_MSG(false, "get_node: returned non specified node");
+// Everything about a node that only depends on the maze and the seed
+struct MapLayoutNode {
+    Point position; // world space, displacement included
+    SDL_Color color;
+    int type;
+    bool connection_left;
+    bool connection_top;
+};
+
+// Built once per maze and seed, the map scene only reads from it
+struct MapLayout {
+    int seed = 0;
+    const uint8_t *maze_buffer = nullptr;
+    int cols = 0;
+    int rows = 0;
+    std::vector<MapLayoutNode> nodes;
+
+    bool matches(const Maze *maze, int for_seed) const {
+        return maze_buffer == maze->buffer && cols == maze->cols && rows == maze->rows && seed == for_seed;
     }
 
-    return node;
-}
+    const MapLayoutNode &get(int x, int y) const {
+        return nodes[x + cols * y];
+    }
 
-std::mt19937 _id_displacement;
-Point get_node_displacement(int node_x, int node_y, int seed) {
-    uint32_t r_seed = (uint32_t)(pseudo_rand_zero_to_one(node_x + seed, node_y + seed) * 3450971324.f);
-    _id_displacement = std::mt19937(r_seed);
+    void build(Maze *maze, int for_seed, int distance_to_next_node) {
+        seed = for_seed;
+        maze_buffer = maze->buffer;
+        cols = maze->cols;
+        rows = maze->rows;
+        
+        nodes.resize(cols * rows);
+        for(int r = 0; r < rows; r++) {
+            for(int c = 0; c < cols; c++) {
+                Node n = get_node(c, r, seed);
+                Point d = get_node_displacement(c, r, seed);
 
-    Point p(RNG::range_i(-20, 20, _id_displacement), RNG::range_i(-20, 20, _id_displacement));
-    return p;
-}
+                MapLayoutNode &node = nodes[c + cols * r];
+                node.position = Point(c * distance_to_next_node + d.x, r * distance_to_next_node + d.y);
+                node.color = n.color;
+                node.type = n.type;
+                node.connection_left = c > 0 && maze->is_open(c, r, Directions::West);
+                node.connection_top = r > 0 && maze->is_open(c, r, Directions::North);
+            }
+        }
+    }
+};
 
 struct MapNavigation {
     Vector2 camera_pos;
@@ -83,26 +74,74 @@ struct MapNavigation {
     const float camera_gutter = 128.0f;
     float camera_y_speed = 0;
     float camera_x_speed = 0;
-    std::vector<Node> _nodes;
+    
+    MapLayout _layout;
+    // lines and nodes, bigger than the screen so small pans just move it
+    RenderLayer _static_layer;
+    Point _static_layer_origin;
+    // hovered node, radius is 0 when nothing is hovered
+    Point _hover_pos;
+    SDL_Color _hover_color;
+    int _hover_radius = 0;
+    // route from the current node to the hovered one, only searched when the hover changes
+    std::vector<Point> _route;
+    Point _route_target = Point(-1, -1);
 
     bool _navigation_enabled = true;
 
     void init() {
-        _nodes.reserve(200);
+        render_layer_init(_static_layer, gw + distance_to_next_node * 2, gh + distance_to_next_node * 2);
     }
 
     void begin() {
         Maze *maze = &Services::game_state()->maze;
-        camera_set_clamp_area(
-            -camera_gutter, 
-            (float)(maze->cols * distance_to_next_node - gw + camera_gutter), 
-            -camera_gutter, 
-            (float)(maze->rows * distance_to_next_node - gh + camera_gutter)
-        );
+        if(infinite()) {
+            camera_reset_clamp_area();
+        } else {
+            camera_set_clamp_area(
+                -camera_gutter, 
+                (float)(maze->cols * distance_to_next_node - gw + camera_gutter), 
+                -camera_gutter, 
+                (float)(maze->rows * distance_to_next_node - gh + camera_gutter)
+            );
+        }
         
         camera_pos = Vector2::from_i(Services::game_state()->current_node.x * distance_to_next_node, Services::game_state()->current_node.y * distance_to_next_node);
         camera_lookat(camera_pos);
         camera_set_speed(0.8f);
+
+        int seed = Services::game_state()->seed;
+        if(!infinite() && !_layout.matches(maze, seed)) {
+            maze_changed();
+        }
+        _static_layer.dirty = true;
+    }
+
+    bool infinite() const {
+        return Services::game_state()->infinite_map;
+    }
+
+    // From the layout, or from the chunk the node is in on the unbounded map
+    MapLayoutNode node_at(int c, int r) {
+        if(!infinite()) {
+            return _layout.get(c, r);
+        }
+        MapChunkCache &chunks = Services::game_state()->map_chunks;
+        const MapChunk &chunk = chunks.require(MapChunkCache::chunk_of(c), MapChunkCache::chunk_of(r));
+        const int i = MapChunkCache::local_of(r) * MAP_CHUNK_SIZE + MapChunkCache::local_of(c);
+        MapLayoutNode node;
+        node.position = Point(c * distance_to_next_node + chunk.displacement_x[i], r * distance_to_next_node + chunk.displacement_y[i]);
+        node.type = chunk.types[i];
+        node.color = get_node_color(node.type);
+        node.connection_left = (chunk.openings[i] & Directions::West) == Directions::West;
+        node.connection_top = (chunk.openings[i] & Directions::North) == Directions::North;
+        return node;
+    }
+
+    // Call after opening, closing or rotating anything in the maze
+    void maze_changed() {
+        _layout.build(&Services::game_state()->maze, Services::game_state()->seed, distance_to_next_node);
+        _static_layer.dirty = true;
     }
 
     void disable_navigation() {
@@ -113,17 +152,17 @@ struct MapNavigation {
         _navigation_enabled = true;
     }
 
-    void node_interact_handler(Node &n) {
+    // returns true when the mouse is over the node, n gets the hover color and radius
+    bool node_interact_handler(Node &n) {
         if(Services::node_event_manager()->screens.size() > 0)
-            return;
+            return false;
 
         Point p;
         Input::mouse_current(p);
         if(Intersects::circle_contains_point(n.render_position.to_vector2(), (float)n.radius, p.to_vector2())) {
             auto next_node = Point(n.maze_pos.x, n.maze_pos.y);
-            Maze *maze = &Services::game_state()->maze;
             auto &current_node = Services::game_state()->current_node;
-            if(maze_connection_is_open(maze, current_node, next_node)) {
+            if(Services::game_state()->connection_is_open(current_node, next_node)) {
                 n.color = Colors::white;
                 n.radius = 16;
                 if(Input::mouse_left_down) {
@@ -141,11 +180,16 @@ struct MapNavigation {
                     Engine::logn("Show node stats or sumtin");
                 }
             }
+            return true;
         }
+        return false;
     }
 
     void update() {
+        _hover_radius = 0;
         if(!_navigation_enabled) {
+            _route.clear();
+            _route_target = Point(-1, -1);
             return;
         }
 
@@ -170,124 +214,155 @@ struct MapNavigation {
         camera_pos.y += camera_y_speed;
         camera_pos.x += camera_x_speed;
 
-        Maze *maze = &Services::game_state()->maze;
-        camera_pos.y = Math::clamp_f(camera_pos.y, -camera_gutter, (float)((maze->cols) * distance_to_next_node) + camera_gutter);
-        camera_pos.x = Math::clamp_f(camera_pos.x, -camera_gutter, (float)((maze->rows) * distance_to_next_node) + camera_gutter);
+        if(!infinite()) {
+            Maze *maze = &Services::game_state()->maze;
+            camera_pos.y = Math::clamp_f(camera_pos.y, -camera_gutter, (float)((maze->cols) * distance_to_next_node) + camera_gutter);
+            camera_pos.x = Math::clamp_f(camera_pos.x, -camera_gutter, (float)((maze->rows) * distance_to_next_node) + camera_gutter);
+        }
         
         camera_follow(camera_pos);
 
         camera_y_speed *= 0.5f;
         camera_x_speed *= 0.5f;
 
-        int seed = Services::game_state()->seed;
+        // only the nodes under the camera can be hovered
         auto camera = get_camera();
-        
-        int startCol = (int)Math::floor_f(camera.x / distance_to_next_node);
-        int endCol = startCol + (gw / distance_to_next_node) + 1;
-        int startRow = (int)Math::floor_f(camera.y / distance_to_next_node);
-        int endRow = startRow + (gh / distance_to_next_node) + 2;
-
-        startRow = Math::clamp_i(startRow, 0, maze->rows - 1);
-        startCol = Math::clamp_i(startCol, 0, maze->cols - 1);
-        endRow = Math::clamp_i(endRow, 0, maze->rows - 1);
-        endCol = Math::clamp_i(endCol, 0, maze->cols - 1);
-
-        auto offsetX = -camera.x + startCol * distance_to_next_node;
-        auto offsetY = -camera.y + startRow * distance_to_next_node;
+        int start_col, end_col, start_row, end_row;
+        visible_range(Vector2(camera.x, camera.y), start_col, end_col, start_row, end_row);
+
+        if(infinite()) {
+            // chunks for the view and ahead of where the camera is going
+            MapChunkCache &chunks = Services::game_state()->map_chunks;
+            chunks.frame_begin();
+            Vector2 velocity((camera.x - camera.last_x) / distance_to_next_node, (camera.y - camera.last_y) / distance_to_next_node);
+            chunks.prefetch(Rectangle(start_col - 1, start_row - 1, end_col - start_col + 3, end_row - start_row + 3), velocity);
+        }
         
         auto &current_node = Services::game_state()->current_node;
 
-        _nodes.clear();
-        for (auto c = startCol; c <= endCol; c++) {
-            for (auto r = startRow; r <= endRow; r++) {
-                auto x = (c - startCol) * distance_to_next_node + offsetX;
-                auto y = (r - startRow) * distance_to_next_node + offsetY;
-
-                Point d = get_node_displacement(c, r, seed);
-                x += d.x;
-                y += d.y;
-
-                Node n = get_node(c, r, seed);
-                n.render_position.x = (int)x;
-                n.render_position.y = (int)y;
+        for (auto c = start_col; c <= end_col; c++) {
+            for (auto r = start_row; r <= end_row; r++) {
+                const MapLayoutNode layout_node = node_at(c, r);
+                
+                Node n;
+                n.type = layout_node.type;
+                n.color = layout_node.color;
+                n.render_position.x = layout_node.position.x - (int)camera.x;
+                n.render_position.y = layout_node.position.y - (int)camera.y;
                 n.radius = 8;
                 n.current = c == current_node.x && r == current_node.y;
                 n.maze_pos.x = c;
                 n.maze_pos.y = r;
                 
-                node_interact_handler(n);
-
-                auto cell = maze->cell(c, r);
-                
-                if ((cell.Openings & Directions::West) == Directions::West) {
-                    auto x_left = (c - 1 - startCol) * distance_to_next_node + offsetX;
-                    Point d_left = get_node_displacement(c - 1, r, seed);
-                    x_left += d_left.x;
-                    float y_left = y - d.y + d_left.y;
-                    n.neighbour_left.x = (int)x_left;
-                    n.neighbour_left.y = (int)y_left;
-
-                    n.connections.left = true;
+                if(node_interact_handler(n)) {
+                    _hover_pos = Point(c, r);
+                    _hover_color = n.color;
+                    _hover_radius = n.radius;
                 }
+            }
+        }
 
-                if ((cell.Openings & Directions::East) == Directions::East) {
-                //     auto x_right = (c + 1 - startCol) * distance_to_next_node + offsetX;
-                //     Point d_right = get_node_displacement(c + 1, r, seed);
-                //     x_right += d_right.x;
-                //     int y_right = y - d.y + d_right.y;
-                //     n.neighbour_right.x = x_right;
-                //     n.neighbour_right.y = y_right;
+        if(_hover_radius == 0) {
+            _route.clear();
+            _route_target = Point(-1, -1);
+        } else if(!(_hover_pos == _route_target)) {
+            _route_target = _hover_pos;
+            Services::game_state()->route_to(_route_target, _route);
+        }
+    }
 
-                    n.connections.right = true;
-                }
-                
-                if ((cell.Openings & Directions::North) == Directions::North) {
-                    auto y_top = (r - 1 - startRow) * distance_to_next_node + offsetY;
-                    Point d_top = get_node_displacement(c, r - 1, seed);
-                    y_top += d_top.y;
-                    float x_top = x - d.x + d_top.x;
-                    n.neighbour_top.x = (int)x_top;
-                    n.neighbour_top.y = (int)y_top;
-
-                    n.connections.top = true;
-                }
+    void visible_range(const Vector2 &camera, int &start_col, int &end_col, int &start_row, int &end_row) {
+        start_col = (int)Math::floor_f(camera.x / distance_to_next_node);
+        end_col = start_col + (gw / distance_to_next_node) + 1;
+        start_row = (int)Math::floor_f(camera.y / distance_to_next_node);
+        end_row = start_row + (gh / distance_to_next_node) + 2;
 
-                if ((cell.Openings & Directions::South) == Directions::South) {
-                //     auto y_bottom = (r + 1 - startRow) * distance_to_next_node + offsetY;
-                //     Point d_bottom = get_node_displacement(c, r + 1, seed);
-                //     y_bottom += d_bottom.y;
-                //     int x_bottom = x - d.x + d_bottom.x;
-                //     n.neighbour_bottom.x = x_bottom;
-                //     n.neighbour_bottom.y = y_bottom;
+        if(infinite()) {
+            return;
+        }
+        start_row = Math::clamp_i(start_row, 0, _layout.rows - 1);
+        start_col = Math::clamp_i(start_col, 0, _layout.cols - 1);
+        end_row = Math::clamp_i(end_row, 0, _layout.rows - 1);
+        end_col = Math::clamp_i(end_col, 0, _layout.cols - 1);
+    }
 
-                    n.connections.bottom = true;
-                }
+    // Lines and nodes for everything under the layer, drawn relative to its origin
+    void render_static_layer() {
+        Vector2 origin = _static_layer_origin.to_vector2();
+        // the layout displacement can push a node or a line a bit outside its cell
+        Vector2 range_from = origin - Vector2((float)distance_to_next_node, (float)distance_to_next_node);
+        int start_col, end_col, start_row, end_row;
+        visible_range(range_from, start_col, end_col, start_row, end_row);
+        end_col += 3;
+        end_row += 3;
+        if(!infinite()) {
+            end_col = Math::clamp_i(end_col, 0, _layout.cols - 1);
+            end_row = Math::clamp_i(end_row, 0, _layout.rows - 1);
+        }
 
+        const int ox = _static_layer_origin.x;
+        const int oy = _static_layer_origin.y;
 
-                _nodes.push_back(n);
+        render_layer_begin(_static_layer);
+        for (auto c = start_col; c <= end_col; c++) {
+            for (auto r = start_row; r <= end_row; r++) {
+                const MapLayoutNode n = node_at(c, r);
+                if(n.connection_left) {
+                    const Point left = node_at(c - 1, r).position;
+                    draw_g_line_RGBA(n.position.x - ox, n.position.y - oy, left.x - ox, left.y - oy, 255, 255, 255, 255);
+                }
+                if(n.connection_top) {
+                    const Point top = node_at(c, r - 1).position;
+                    draw_g_line_RGBA(n.position.x - ox, n.position.y - oy, top.x - ox, top.y - oy, 255, 255, 255, 255);
+                }
             }
         }
+        for (auto c = start_col; c <= end_col; c++) {
+            for (auto r = start_row; r <= end_row; r++) {
+                const MapLayoutNode n = node_at(c, r);
+                SDL_Color color = n.color;
+                draw_g_circle_filled_color(n.position.x - ox, n.position.y - oy, 8, color);
+            }
+        }
+        render_layer_end(_static_layer);
     }
 
     void render() {
-        for(auto &n : _nodes) {
-            if(n.connections.left) {
-                draw_g_line_RGBA(n.render_position.x, n.render_position.y, n.neighbour_left.x, n.neighbour_left.y, 255, 255, 255, 255);
-            }
-            if(n.connections.top) {
-                draw_g_line_RGBA(n.render_position.x, n.render_position.y, n.neighbour_top.x, n.neighbour_top.y, 255, 255, 255, 255);
-            }
-            // if(n.connections.right) {
-            //     draw_g_line_RGBA(n.position.x, n.position.y, n.neighbour_right.x, n.neighbour_right.y, 255, 255, 255, 255);
-            // }
-            // if(n.connections.bottom) {
-            //     draw_g_line_RGBA(n.position.x, n.position.y, n.neighbour_bottom.x, n.neighbour_bottom.y, 255, 255, 255, 255);
-            // }
-            if(n.current) {
-                static SDL_Color color = Colors::yellow;
-                draw_g_circle_color(n.render_position.x, n.render_position.y, n.radius + 8, color);    
-            }
-            draw_g_circle_filled_color(n.render_position.x, n.render_position.y, n.radius, n.color);
+        if(!infinite() && _layout.nodes.empty()) {
+            return;
+        }
+
+        const Vector2 camera_position = camera_render_position();
+        const int camera_x = (int)camera_position.x;
+        const int camera_y = (int)camera_position.y;
+
+        // the layer reaches distance_to_next_node past each screen edge, redraw it
+        // centered on the camera when the camera pans past that
+        const int dx = camera_x - _static_layer_origin.x;
+        const int dy = camera_y - _static_layer_origin.y;
+        const int margin = distance_to_next_node * 2;
+        if(_static_layer.dirty || dx < 0 || dy < 0 || dx > margin || dy > margin) {
+            _static_layer_origin = Point(camera_x - distance_to_next_node, camera_y - distance_to_next_node);
+            render_static_layer();
+        }
+        draw_render_layer(_static_layer, _static_layer_origin.x - camera_x, _static_layer_origin.y - camera_y);
+
+        static SDL_Color route_color = { 255, 255, 0, 255 };
+        for(size_t i = 1; i < _route.size(); i++) {
+            const Point from = node_at(_route[i - 1].x, _route[i - 1].y).position;
+            const Point to = node_at(_route[i].x, _route[i].y).position;
+            draw_g_line_RGBA(from.x - camera_x, from.y - camera_y, to.x - camera_x, to.y - camera_y, route_color.r, route_color.g, route_color.b, route_color.a);
+        }
+
+        auto &current_node = Services::game_state()->current_node;
+        const MapLayoutNode current = node_at(current_node.x, current_node.y);
+        const bool current_hovered = _hover_radius > 0 && _hover_pos.x == current_node.x && _hover_pos.y == current_node.y;
+        static SDL_Color color = Colors::yellow;
+        draw_g_circle_color(current.position.x - camera_x, current.position.y - camera_y, (current_hovered ? _hover_radius : 8) + 8, color);
+
+        if(_hover_radius > 0) {
+            const MapLayoutNode hovered = node_at(_hover_pos.x, _hover_pos.y);
+            draw_g_circle_filled_color(hovered.position.x - camera_x, hovered.position.y - camera_y, _hover_radius, _hover_color);
         }
     }
 };
@@ -330,6 +405,7 @@ void on_close_fleet_ui() {
 
 void MapScene::begin() {
 	Engine::logn("[MAP] Begin");
+    _background = Resources::sprite_acquire("background");
     Engine::logn("seed: %d",  Services::game_state()->seed);
     Noise::set_seed(Services::game_state()->seed);
     //not_random_generator = std::mt19937(Services::game_state()->seed);
@@ -361,11 +437,11 @@ void MapScene::end() {
     Engine::logn("[MAP] End");
 	render_buffer.clear();
     camera_lookat(Vector2::from_i(gw / 2, gh / 2));
+    Resources::sprite_release(_background);
 }
 
 void MapScene::update() {
-    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
-	
+    PROFILE_SCOPE("map update");
     map_navigator.update();
     Services::node_event_manager()->update();
 
@@ -373,21 +449,12 @@ void MapScene::update() {
     Services::ui()->update();
     
     // render_export(render_buffer);
-
-	std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
-	auto diff = t2 - t1;
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>( diff ).count();
-	auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>( diff ).count();
-	std::string frame_duration_mu = "update time mu: " + std::to_string(duration);
-	std::string frame_duration_ms = "update time ms: " + std::to_string(duration_ms);
-	FrameLog::log(frame_duration_mu);
-	FrameLog::log(frame_duration_ms);
 }
 
 void MapScene::render() {
 	renderer_clear();
     
-    draw_sprite(Resources::sprite_get("background"), 0, 0);
+    draw_sprite(_background.sprite, 0, 0);
     
     map_navigator.render();
     Services::node_event_manager()->render();
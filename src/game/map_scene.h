@@ -14,7 +14,8 @@ class MapScene : public Scene {
                 void unload() override;
         private:
                 RenderBuffer render_buffer;
-                Sprite _background;
+                // held while the scene is active so it is never evicted under it
+                SpriteHandle _background;
 };
 
 #endif
\ No newline at end of file
@@ -14,6 +14,8 @@ void start_new_game() {
 
 void MenuScene::begin() {
 	Engine::logn("[MENU] Begin");
+	// nothing moves here, no need to draw at full rate
+	FramePacer::set_target_fps(30);
 
 	Button start_button = Button(gw / 2, gh / 2 - 20, "Start");
 	start_button.on_click = start_new_game;
@@ -28,6 +30,7 @@ void MenuScene::begin() {
 void MenuScene::end() {
 	Engine::logn("[MENU] End");
 	Services::ui()->clear();
+	FramePacer::set_target_fps(FramePacer::default_target_fps());
 }
 
 void MenuScene::update() {
@@ -9,6 +9,7 @@
 
 template<typename Entity>
 void system_move_forward(Entity &entities) {
+    PROFILE_SCOPE("move forward");
     for(auto &pr : entities) {
         if(pr.velocity.value.x != 0 || pr.velocity.value.y != 0) {
             pr.position.last = pr.position.value;
@@ -19,6 +20,7 @@ void system_move_forward(Entity &entities) {
 
 template<typename Entity>
 void system_velocity_increase(Entity &entities) {
+    PROFILE_SCOPE("velocity increase");
     for(auto &e : entities) {
         if(e.velocity.change != 0) {
             e.velocity.value *= e.velocity.change;
@@ -31,6 +33,7 @@ void system_velocity_increase(Entity &entities) {
 
 template<typename Entity>
 void system_remove_outside(Entity &entities, Rectangle &world_bounds) {
+    PROFILE_SCOPE("remove outside");
     for(auto &entity : entities) {
         if(!world_bounds.contains(entity.position.value.to_point())) {
             entity.life_time.marked_for_deletion = true;
@@ -40,6 +43,7 @@ void system_remove_outside(Entity &entities, Rectangle &world_bounds) {
 
 template<typename Entity>
 void system_homing(Entity &entities) {
+    PROFILE_SCOPE("homing");
     for(auto &e : entities) {
         if(!e.homing.enabled) {
             continue;
@@ -100,6 +104,7 @@ struct CollisionPairs {
 
 template<typename First, typename Second>
 void system_collisions(CollisionPairs &collision_pairs, const First &entity_first, const Second &entity_second) {
+    PROFILE_SCOPE("collisions");
     for(auto &first : entity_first) {
         for(auto &second : entity_second) {
             if(first.faction.faction == second.faction.faction) {
@@ -142,6 +147,7 @@ void system_collisions(CollisionPairs &collision_pairs, const First &entity_firs
 
 template<typename Entity>
 void system_shield_recharge(Entity &entities) {
+    PROFILE_SCOPE("shield recharge");
     for(auto &entity : entities) {
         entity.defense.shield_recharge(Time::delta_time);
     }
@@ -149,6 +155,7 @@ void system_shield_recharge(Entity &entities) {
 
 template<typename Entity>
 void system_update_ttl(Entity &entities) {
+    PROFILE_SCOPE("update ttl");
     for(auto &entity : entities) {
         if(entity.life_time.ttl > 0) {
             entity.life_time.time += Time::delta_time;
@@ -161,6 +168,7 @@ void system_update_ttl(Entity &entities) {
 
 template<typename Entity> 
 void system_animation(Entity &entities)  {
+    PROFILE_SCOPE("animation");
     // Animation system
     for (auto &ship : entities) { 
         ship.sprite.update_animation(Time::delta_time);
@@ -63,31 +63,40 @@ namespace UnitCreator {
         lazer_rect.h = height;
     }
     
-    FighterShip create_fighter(const FighterData &f, const int &faction, const Vector2 &position, ECS::EntityManager &entity_manager) {
-        auto &f_cfg = Services::db()->get_fighter_config(f.id);
+    // Idle and blinking hit animation for a ship, registered once per sprite
+    static AnimationId ship_animations(const std::string &sprite_base, const float hit_fps) {
+        AnimationId animations = Animations::find(sprite_base);
+        if(animations != Animations::NONE) {
+            return animations;
+        }
 
-        FighterShip ship(entity_manager.create(), f_cfg.type);
-        ship.faction = FactionComponent { faction };
-        ship.position = position;
-        //ship.position = RNG::vector2(position.x - 10, position.x + 10, position.y - 8, position.y + 8);
+        std::string white_sprite = sprite_base + "_w";
+        return Animations::add(sprite_base, {
+            AnimationClip({ { "combat_sprites", sprite_base } }, 0, false),
+            AnimationClip({ 
+                { "combat_sprites", white_sprite },
+                { "combat_sprites", sprite_base },
+                { "combat_sprites", white_sprite },
+                { "combat_sprites", sprite_base },
+                { "combat_sprites", white_sprite },
+                { "combat_sprites", sprite_base },
+                { "combat_sprites", white_sprite }
+            }, hit_fps, false)
+        });
+    }
+
+    // Prefabs are compiled once from config in build_prefabs.
+    // Spawning copies one and sets entity, faction, position and targets.
+    std::vector<FighterShip> _fighter_prefabs;
+    std::vector<int> _fighter_prefab_by_id;
+    std::vector<Projectile> _projectile_prefabs;
+
+    FighterShip build_fighter_prefab(const FighterConfig &f_cfg) {
+        FighterShip ship(ECS::Entity(), f_cfg.type);
         ship.defense = DefenseComponent(f_cfg.defense.hp, f_cfg.defense.shield);
 
-        std::string fighter_white_sprite = f_cfg.sprite_base + "_w";
-
-        SpriteComponent s = SpriteComponent({ 
-            Animation("idle", { { "combat_sprites", f_cfg.sprite_base } }, 0, false),
-            Animation("hit", { 
-                { "combat_sprites", fighter_white_sprite },
-                { "combat_sprites", f_cfg.sprite_base },
-                { "combat_sprites", fighter_white_sprite },
-                { "combat_sprites", f_cfg.sprite_base },
-                { "combat_sprites", fighter_white_sprite },
-                { "combat_sprites", f_cfg.sprite_base },
-                { "combat_sprites", fighter_white_sprite }
-            },  6, false)
-        });
+        SpriteComponent s = SpriteComponent(ship_animations(f_cfg.sprite_base, 6));
         s.layer = FIGHTER_LAYER;
-        s.flip = faction == PLAYER_FACTION ? 0 : 1;
         ship.sprite = s;
         
         for(auto &w : f_cfg.weapons) {
@@ -100,33 +109,61 @@ namespace UnitCreator {
             ship.abilities.add(weaponComponent);
         }
         
-        auto sprite_sheet_index = Resources::sprite_sheet_index("combat_sprites");
-        auto rect = Resources::sprite_get_from_sheet(sprite_sheet_index, f_cfg.sprite_base);
-        ship.collision = CollisionData(rect.w, rect.h);
+        auto &frame = ship.sprite.get_current_frame();
+        ship.collision = CollisionData(frame.w, frame.h);
 
         return ship;
     }
 
+    Projectile build_projectile_prefab(const ProjectileType &projectile_type) {
+        Projectile p = Projectile(ECS::Entity());
+        p.sprite = SpriteComponent(Animations::add_sprite("combat_sprites", weapon_projectile_sprite(projectile_type)));
+        p.sprite.layer = PROJECTILE_LAYER;
+        p.sprite.line = projectile_type == ProjectileType::LazerBeamGreen;
+        p.homing.enabled = projectile_type == ProjectileType::Missile;
+        return p;
+    }
+
+    // Needs targeters and the combat sprite sheet, call after init_targeters
+    void build_prefabs() {
+        _fighter_prefabs.clear();
+        _fighter_prefab_by_id.clear();
+        for(auto &f_cfg : Services::db()->get_fighters()) {
+            if(f_cfg.id >= (int)_fighter_prefab_by_id.size()) {
+                _fighter_prefab_by_id.resize(f_cfg.id + 1, -1);
+            }
+            _fighter_prefab_by_id[f_cfg.id] = (int)_fighter_prefabs.size();
+            _fighter_prefabs.push_back(build_fighter_prefab(f_cfg));
+        }
+
+        _projectile_prefabs.clear();
+        for(int i = 0; i < ProjectileType::COUNT; i++) {
+            _projectile_prefabs.push_back(build_projectile_prefab((ProjectileType)i));
+        }
+    }
+
+    const FighterShip &fighter_prefab(const int &id) {
+        ASSERT_WITH_MSG(id >= 0 && id < (int)_fighter_prefab_by_id.size() && _fighter_prefab_by_id[id] >= 0, Text::format("No fighter prefab with id: %d", id));
+        return _fighter_prefabs[_fighter_prefab_by_id[id]];
+    }
+
+    FighterShip create_fighter(const FighterData &f, const int &faction, const Vector2 &position, ECS::EntityManager &entity_manager) {
+        FighterShip ship = fighter_prefab(f.id);
+        ship.entity = entity_manager.create();
+        ship.faction = FactionComponent { faction };
+        ship.position = position;
+        //ship.position = RNG::vector2(position.x - 10, position.x + 10, position.y - 8, position.y + 8);
+        ship.sprite.flip = faction == PLAYER_FACTION ? 0 : 1;
+        return ship;
+    }
+
     void create_player_mothership(const MothershipConfig &mothership, ECS::EntityManager &entity_manager, std::vector<MotherShip> &motherships) {
         Vector2 position = Vector2(70, (float)gh / 2);
 
         MotherShip ship(entity_manager.create());
         ship.faction = FactionComponent { PLAYER_FACTION };
 
-        std::string mothership_white_sprite = mothership.sprite_base + "_w";
-
-        SpriteComponent s = SpriteComponent({ 
-                Animation("idle", { { "combat_sprites", mothership.sprite_base } }, 0, false),
-                Animation("hit", { 
-                    { "combat_sprites", mothership_white_sprite },
-                    { "combat_sprites", mothership.sprite_base },
-                    { "combat_sprites", mothership_white_sprite },
-                    { "combat_sprites", mothership.sprite_base },
-                    { "combat_sprites", mothership_white_sprite },
-                    { "combat_sprites", mothership.sprite_base },
-                    { "combat_sprites", mothership_white_sprite }
-                },  8, false)
-            });
+        SpriteComponent s = SpriteComponent(ship_animations(mothership.sprite_base, 8));
         s.layer = MOTHERSHIP_LAYER;
         s.flip = 0;
         ship.sprite = s;
@@ -164,18 +201,7 @@ namespace UnitCreator {
 
         MotherShip ship(entity_manager.create());
         ship.faction = FactionComponent { ENEMY_FACTION };
-        SpriteComponent s = SpriteComponent({ 
-                Animation("idle", { { "combat_sprites", "mother2" } }, 0, false),
-                Animation("hit", { 
-                    { "combat_sprites", "mother2_w" },
-                    { "combat_sprites", "mother2" },
-                    { "combat_sprites", "mother2_w" },
-                    { "combat_sprites", "mother2" },
-                    { "combat_sprites", "mother2_w" },
-                    { "combat_sprites", "mother2" },
-                    { "combat_sprites", "mother2_w" }
-                },  8, false)
-            });
+        SpriteComponent s = SpriteComponent(ship_animations("mother2", 8));
         
         s.layer = MOTHERSHIP_LAYER;
         s.flip = 1;
@@ -208,88 +234,43 @@ namespace UnitCreator {
         const float angle = Math::angle_between_v(spawn.position, spawn.target_position);
         const ProjectilePayLoad &payload = spawn.payload;
         
-        auto sc = SpriteComponent("combat_sprites", weapon_projectile_sprite(spawn.projectile_type));
-        sc.layer = PROJECTILE_LAYER;
-        sc.rotation = angle;
-
-        Projectile p(entity_manager.create());
-
-        if(spawn.projectile_type == ProjectileType::LazerBeamGreen) {
-            sc.line = true;
-            auto direction = Math::direction_from_angle(angle);    
-            // if(payload.accuracy < chance) {
-            //     SDL_Rect lazer_rect;
-            //     int height = payload.radius;
-            //     auto ext = direction * 30;
-            //     calc_lazer(lazer_rect, spawn.position, spawn.target_position + ext, height);
-
-            //     sc.w = lazer_rect.w;
-            //     sc.h = lazer_rect.h;
-
-            //     ProjectileMiss p(entity_manager.create());
-            //     p.position = Position(spawn.target_position);
-            //     p.position.last = Vector2((float)lazer_rect.x, (float)lazer_rect.y);
-            //     //p.velocity = Velocity();
-            //     p.sprite = sc;
-            //     p.life_time.ttl = 0.2f;
-            //     _projectile_missed.push_back(p);
-            // } else {
-                SDL_Rect lazer_rect;
-                int height = payload.radius;
-                calc_lazer(lazer_rect, spawn.position, spawn.target_position, height);
-
-                sc.w = lazer_rect.w;
-                sc.h = lazer_rect.h;
-                
-                p.position = Position(spawn.target_position);
-                p.position.last = Vector2((float)lazer_rect.x, (float)lazer_rect.y);
-                p.collision = CollisionData(payload.radius);
-                p.faction.faction = spawn.faction;
-                p.payload = payload;
-                p.sprite = sc;
-                
-                p.collision = CollisionData(payload.radius);
-                projectiles.push_back(p);
-            //}
-        } else if(spawn.projectile_type == ProjectileType::Missile) {
+        Projectile p = _projectile_prefabs[spawn.projectile_type];
+        p.entity = entity_manager.create();
+        p.sprite.rotation = angle;
+        p.faction.faction = spawn.faction;
+        p.payload = payload;
+        p.collision = CollisionData(payload.radius);
+
+        if(p.sprite.line) {
+            SDL_Rect lazer_rect;
+            int height = payload.radius;
+            calc_lazer(lazer_rect, spawn.position, spawn.target_position, height);
+
+            p.sprite.w = lazer_rect.w;
+            p.sprite.h = lazer_rect.h;
+            
+            p.position = Position(spawn.target_position);
+            p.position.last = Vector2((float)lazer_rect.x, (float)lazer_rect.y);
+        } else if(p.homing.enabled) {
             auto homing_angle = angle + RNG::range_f(-40, 40);
             auto direction = Math::direction_from_angle(homing_angle);
-            auto velocity = direction * spawn.projectile_speed;
         
             p.position = Position(spawn.position);
-            p.faction.faction = spawn.faction;
-            p.payload = payload;
-            
-            p.sprite = sc;
-            p.velocity = Velocity(velocity);
+            p.velocity = Velocity(direction * spawn.projectile_speed);
             p.velocity.change = spawn.projectile_speed_increase;
             p.velocity.max = spawn.projectile_speed_max;
 
-            p.collision = CollisionData(payload.radius);
-
-            p.homing.enabled = true;
             p.homing.target = spawn.target;
             p.homing.target_position = spawn.target_position;
-
-            projectiles.push_back(p);
-            
         } else {
             auto direction = Math::direction_from_angle(angle);
-            auto velocity = direction * spawn.projectile_speed;
             
             p.position = Position(spawn.position);
-            p.faction.faction = spawn.faction;
-            p.payload = payload;
-            
-            p.sprite = sc;
-            p.velocity = Velocity(velocity);
+            p.velocity = Velocity(direction * spawn.projectile_speed);
             p.velocity.change = spawn.projectile_speed_increase;
-
-            p.collision = CollisionData(payload.radius);
-
-            projectiles.push_back(p);
-            
         }
+
+        projectiles.push_back(p);
     }
 }
 
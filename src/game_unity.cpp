@@ -1,10 +1,12 @@
 #include "abilities.cpp"
 #include "battle_controller.cpp"
+#include "components.cpp"
 #include "data_repository.cpp"
 #include "events.cpp"
 #include "game.cpp"
 #include "game_state.cpp"
 #include "level_scene.cpp"
+#include "map_chunks.cpp"
 #include "map_scene.cpp"
 #include "menu_scene.cpp"
 #include "node_event_manager.cpp"
@@ -3,6 +3,11 @@
 #include "game.h"
 
 #include <iostream>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
 
 gameTimer timer;
 
@@ -10,60 +15,270 @@ void windowEvent(const SDL_Event * event);
 
 static SDL_Event event;
 
+// window keys change the window so they are handled where events are polled
+static void window_keys(const SDL_Event &event) {
+	if (event.key.keysym.sym == SDLK_F1) {
+		window_set_scale(1);
+		window_center();
+	} else if (event.key.keysym.sym == SDLK_F2) {
+		window_set_scale(2);
+		window_center();
+	} else if (event.key.keysym.sym == SDLK_F3) {
+		window_set_scale(3);
+		window_center();
+	} else if (event.key.keysym.sym == SDLK_F4) {
+		window_set_scale(3);
+		window_toggle_fullscreen(false);
+	} else if (event.key.keysym.sym == SDLK_F5) {
+		window_set_scale(3);
+		window_toggle_fullscreen(true);
+	}
+}
+
+static void input_event(const SDL_Event &event) {
+	Input::map(&event);
+	if(event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
+		Engine::exit();
+	}
+}
+
 void input() {
 	Input::update_states();
 	while (SDL_PollEvent(&event)) {
-		Input::map(&event);
+		input_event(event);
 		
 		switch(event.type) {
-			case SDL_QUIT:
-				Engine::exit();
-				break;
 			case SDL_WINDOWEVENT: {
 				// windowEvent(&event);
         		break;
 			} 
 			case SDL_KEYDOWN: {
-				if (event.key.keysym.sym == SDLK_ESCAPE) {
-					Engine::exit();
-				} else if (event.key.keysym.sym == SDLK_F1) {
-					window_set_scale(1);
-					window_center();
-				} else if (event.key.keysym.sym == SDLK_F2) {
-					window_set_scale(2);
-					window_center();
-				} else if (event.key.keysym.sym == SDLK_F3) {
-					window_set_scale(3);
-					window_center();
-				} else if (event.key.keysym.sym == SDLK_F4) {
-					window_set_scale(3);
-					window_toggle_fullscreen(false);
-				} else if (event.key.keysym.sym == SDLK_F5) {
-					window_set_scale(3);
-					window_toggle_fullscreen(true);
-				}
+				window_keys(event);
 				break;
 			}
 		}
 	}
 }
 
+// Latency is from when input for a frame was read until it was presented,
+// jitter is the average deviation of the time between presents.
+struct FrameTiming {
+	bool enabled = false;
+	uint64_t last_present = 0;
+	double latency_ms = 0;
+	double latency_max_ms = 0;
+	double interval_ms = 0;
+	double jitter_ms = 0;
+
+	void add(uint64_t input_time, uint64_t present_time) {
+		if(!enabled) {
+			return;
+		}
+		const double ms_per_tick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+		double latency = (double)(present_time - input_time) * ms_per_tick;
+		latency_ms += (latency - latency_ms) * 0.05;
+		latency_max_ms = latency > latency_max_ms ? latency : latency_max_ms;
+		if(last_present != 0) {
+			double interval = (double)(present_time - last_present) * ms_per_tick;
+			interval_ms += (interval - interval_ms) * 0.05;
+			jitter_ms += (std::abs(interval - interval_ms) - jitter_ms) * 0.05;
+		}
+		last_present = present_time;
+	}
+
+	void report(const char *mode) {
+		if(!enabled) {
+			return;
+		}
+		Engine::logn("[FRAME] %s latency %.2f ms (max %.2f), interval %.2f ms, jitter %.2f ms", 
+			mode, latency_ms, latency_max_ms, interval_ms, jitter_ms);
+		latency_max_ms = 0;
+	}
+};
+
+static FrameTiming frame_timing;
+
+// Spiral of death guard, after this many catch up updates the rest of the time is dropped
+static int max_updates_per_frame = 5;
+
+static inline bool catch_up_capped(int updates) {
+	if(updates < max_updates_per_frame) {
+		return false;
+	}
+	uint32_t dropped = (uint32_t)(timer.accumulator / timer.fixed_dt);
+	FramePacer::drop_updates(dropped);
+	timer.accumulator -= dropped * timer.fixed_dt;
+	return true;
+}
+
+// Pipelined: the simulation thread updates and records the frame, the main thread
+// polls events and replays the previous frame at the same time.
+static std::mutex pending_events_mutex;
+static std::vector<SDL_Event> pending_events;
+static std::atomic<bool> simulation_running(true);
+
+static void input_pipelined() {
+	static std::vector<SDL_Event> events;
+	Input::update_states();
+	{
+		std::lock_guard<std::mutex> lock(pending_events_mutex);
+		events.swap(pending_events);
+	}
+	for(auto &e : events) {
+		input_event(e);
+	}
+	events.clear();
+}
+
+static void simulation_loop() {
+	Profiler::set_thread_name("simulation");
+	uint64_t input_time = SDL_GetPerformanceCounter();
+    timer.now = SDL_GetPerformanceCounter();
+    timer.last = 0;
+    timer.accumulator = 0;
+
+	while (Engine::is_running()) {
+		FlightRecorder::frame_begin();
+		timer.last = timer.now;
+        timer.now = SDL_GetPerformanceCounter();
+        timer.dt = ((timer.now - timer.last)/(double)SDL_GetPerformanceFrequency());
+        timer.accumulator += timer.dt;
+
+		int updates = 0;
+        while (timer.accumulator >= timer.fixed_dt && !catch_up_capped(updates)) {
+			input_time = SDL_GetPerformanceCounter();
+			input_pipelined();
+			Engine::update();
+            timer.accumulator -= timer.fixed_dt;
+			updates++;
+        }
+
+		Time::alpha = (float)(timer.accumulator / timer.fixed_dt);
+		renderer_pipeline_stamp(input_time);
+		Engine::render();
+		FlightRecorder::frame_end();
+	}
+
+	simulation_running = false;
+	renderer_pipeline_stop();
+}
+
+static void run_pipelined() {
+	renderer_pipeline_start();
+	std::thread simulation(simulation_loop);
+
+	uint32_t fps_lasttime = SDL_GetTicks();
+	uint32_t fps_frames = 0;
+	while (simulation_running) {
+		while (SDL_PollEvent(&event)) {
+			if(event.type == SDL_KEYDOWN) {
+				window_keys(event);
+			}
+			std::lock_guard<std::mutex> lock(pending_events_mutex);
+			pending_events.push_back(event);
+		}
+
+		uint64_t input_time;
+		if(renderer_pipeline_present(&input_time)) {
+			frame_timing.add(input_time, SDL_GetPerformanceCounter());
+			fps_frames++;
+		}
+
+		if (fps_lasttime < SDL_GetTicks() - 1000U) {
+			fps_lasttime = SDL_GetTicks();
+			Engine::current_fps = fps_frames;
+			fps_frames = 0;
+			frame_timing.report("pipelined");
+		}
+
+		FramePacer::wait();
+	}
+
+	simulation.join();
+	renderer_pipeline_end();
+}
+
 const unsigned int STARTING_SCALE = 2; // 1,2,3 are good values ;)
 int main(int argc, char* argv[]) {
+	bool benchmark = false;
+	bool pipelined = false;
+	int tick_rate = 60;
+	int target_fps = -1;
+	const char *dump_folder = NULL;
+	const char *log_file = NULL;
+	float spike_ms = 0;
+	float spike_window_seconds = 5;
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--bench") == 0) {
+			benchmark = true;
+		} else if(strcmp(argv[i], "--headless") == 0) {
+			renderer_set_headless(true);
+		} else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+			dump_folder = argv[++i];
+		} else if(strcmp(argv[i], "--pipelined") == 0) {
+			pipelined = true;
+		} else if(strcmp(argv[i], "--profile") == 0) {
+			Profiler::set_enabled(true);
+		} else if(strcmp(argv[i], "--track-allocations") == 0) {
+			Allocations::set_enabled(true);
+		} else if(strcmp(argv[i], "--flight-recorder") == 0 && i + 1 < argc) {
+			// frames slower than this many ms are dumped with the seconds before them
+			spike_ms = (float)atof(argv[++i]);
+		} else if(strcmp(argv[i], "--flight-seconds") == 0 && i + 1 < argc) {
+			spike_window_seconds = (float)atof(argv[++i]);
+			spike_window_seconds = spike_window_seconds > 0 ? spike_window_seconds : 5;
+		} else if(strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+			log_file = argv[++i];
+		} else if(strcmp(argv[i], "--frame-stats") == 0) {
+			frame_timing.enabled = true;
+		} else if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+			// updates per second, rendering interpolates between them
+			tick_rate = atoi(argv[++i]);
+			tick_rate = tick_rate > 0 ? tick_rate : 60;
+		} else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			// 0 runs unlimited
+			target_fps = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--infinite-map") == 0) {
+			game_set_infinite_map(true);
+		} else if(strcmp(argv[i], "--max-updates") == 0 && i + 1 < argc) {
+			max_updates_per_frame = atoi(argv[++i]);
+			max_updates_per_frame = max_updates_per_frame > 0 ? max_updates_per_frame : 1;
+		}
+	}
+
+	Log::init(log_file);
+
 	if(!renderer_init("TITLE", 640, 360, STARTING_SCALE)) {
 		printf("init renderer failed");
 		return 1;
 	}
 
 	Engine::init();
+
+	// pace to the display refresh rate unless told otherwise
+	if(target_fps < 0) {
+		SDL_DisplayMode mode;
+		target_fps = (SDL_GetCurrentDisplayMode(0, &mode) == 0 && mode.refresh_rate > 0) ? mode.refresh_rate : 60;
+	}
+	FramePacer::init(target_fps);
+	if(spike_ms > 0) {
+		FlightRecorder::enable(spike_window_seconds, spike_ms);
+	}
 	
 	game_load();
+
+	if(benchmark) {
+		int result = game_benchmark(dump_folder);
+		Engine::cleanup();
+		renderer_destroy();
+		return result;
+	}
 	
 	// Initiate timer
     timer.now = SDL_GetPerformanceCounter();
     timer.last = 0;
     timer.dt = 0;
-    timer.fixed_dt = 1.0/60.0;
+    timer.fixed_dt = 1.0/(double)tick_rate;
     timer.accumulator = 0;
 
 	// FPS timer
@@ -75,21 +290,36 @@ int main(int argc, char* argv[]) {
 	Time::delta_time_fixed = (float)timer.fixed_dt;
 	Time::delta_time_raw = (float)timer.fixed_dt;
 
+	if(pipelined) {
+		run_pipelined();
+		Engine::cleanup();
+		renderer_destroy();
+		return 0;
+	}
+
+	uint64_t input_time = SDL_GetPerformanceCounter();
     while (Engine::is_running()) {
+		FlightRecorder::frame_begin();
 		timer.last = timer.now;
         timer.now = SDL_GetPerformanceCounter();
         timer.dt = ((timer.now - timer.last)/(double)SDL_GetPerformanceFrequency());
         // This timing method is the 4th (Free the Physics) from this article: https://gafferongames.com/post/fix_your_timestep/
         timer.accumulator += timer.dt;
 		
-        while (timer.accumulator >= timer.fixed_dt) {	
+		int updates = 0;
+        while (timer.accumulator >= timer.fixed_dt && !catch_up_capped(updates)) {	
+			input_time = SDL_GetPerformanceCounter();
 			input();
 			Engine::update();
 			
             timer.accumulator -= timer.fixed_dt;
+			updates++;
         }
 		
+		Time::alpha = (float)(timer.accumulator / timer.fixed_dt);
 		Engine::render();
+		frame_timing.add(input_time, SDL_GetPerformanceCounter());
+		FlightRecorder::frame_end();
 
 		fps_frames++;
 
@@ -99,7 +329,10 @@ int main(int argc, char* argv[]) {
 			fps_current = fps_frames;
 			fps_frames = 0;
 			Engine::current_fps = fps_current;
+			frame_timing.report("serial");
 		}
+
+		FramePacer::wait();
 	}
 	
 	Engine::cleanup();